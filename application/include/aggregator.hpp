@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <deque>
+
+// Incremental statistics of the count of one video, for the dashboards. It is fed
+// with every change of the count and keeps:
+//  - the time-weighted average and the peak of the count over a sliding window
+//    (5 minutes by default),
+//  - the number of entries (increases of the total count) over a sliding window
+//    (1 hour by default),
+//  - the entries and the peak count of fixed time buckets (1 hour by default),
+//  - the overall peak count.
+// Updates and queries take amortized O(1) time, and the memory only holds the
+// changes that are still inside the windows. Times are in seconds and must not
+// go backwards.
+class CountAggregator {
+public:
+	struct Bucket {
+		long index;     // Start time of the bucket divided by its length
+		int entries;
+		int peak;
+	};
+
+	CountAggregator(double occupancyWindow = 300, double entryWindow = 3600,
+	                double bucketLength = 3600, size_t maxBuckets = 24);
+
+	// The count or the total count of the video changed at time now
+	void update(double now, int count, int total);
+
+	int current() const
+	{
+		return count;
+	}
+
+	int peak() const
+	{
+		return overallPeak;
+	}
+
+	// Queries over the windows ending at time now
+	double averageOccupancy(double now);
+	int windowPeak(double now);
+	int windowEntries(double now);
+
+	// Closed buckets, oldest first, followed by the current one
+	const std::deque<Bucket> &buckets(double now);
+
+	double bucketLength() const
+	{
+		return bucketSeconds;
+	}
+
+private:
+	struct Segment {
+		double start;
+		double end;     // Only used by the peak deque, open segments end at +inf
+		int count;
+	};
+
+	struct Entry {
+		double time;
+		int entries;
+	};
+
+	void advance(double now);
+
+	double occupancyWindow;
+	double entryWindow;
+	double bucketSeconds;
+	size_t maxBuckets;
+
+	bool started;
+	double firstTime;
+	double lastTime;
+	int count;
+	int total;
+	int overallPeak;
+
+	// Occupancy: segments of constant count, the last one still open, and the
+	// integral of the closed ones
+	std::deque<Segment> segments;
+	double closedArea;
+
+	// Peak: segments with decreasing counts, so the front is the window maximum
+	std::deque<Segment> peaks;
+
+	std::deque<Entry> entries;
+	int entriesSum;
+
+	std::deque<Bucket> hourly;
+};
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+// Heap allocation counters, enabled by building with -DALLOC_STATS=ON.
+// Both operator new and cv::Mat buffer allocations are counted, but only on the
+// threads that called allocStatsTrackThread(), so the inference threads of the
+// plugins do not show up in the numbers of the main loop.
+#ifdef ALLOC_STATS
+void allocStatsTrackThread();
+void allocStatsSetPaused(bool paused);
+size_t allocStatsCount();
+size_t allocStatsBytes();
+#else
+inline void allocStatsTrackThread() {}
+inline void allocStatsSetPaused(bool) {}
+inline size_t allocStatsCount() { return 0; }
+inline size_t allocStatsBytes() { return 0; }
+#endif
+
+// The allocations of the current thread are not counted while an AllocStatsPause
+// exists, for the periodic work that does not run on every frame
+struct AllocStatsPause {
+	AllocStatsPause() { allocStatsSetPaused(true); }
+	~AllocStatsPause() { allocStatsSetPaused(false); }
+};
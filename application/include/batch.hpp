@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <string>
+
+#include <inference_backend.hpp>
+
+// Settings of the offline batch mode
+struct BatchConfig {
+	std::string input;          // Directory of video files, or text file with one path per line
+	std::string outputDir;      // Where the per-file results and summary.json are written
+	std::string labelsFile;
+	std::string label;          // Class counted in every file
+	size_t workers = 1;
+	int candidateConfidence = 6;
+};
+
+// Process the video files of the batch at full speed. Every worker processes one
+// file at a time, every frame of it, on its own request of the shared backend, which
+// must have at least config.workers requests. Returns 0 on success, or the exit
+// code of the application.
+int runBatch(const BatchConfig &config, InferenceBackend &backend);
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "opencv2/core.hpp"
+#include "opencv2/videoio.hpp"
+
+// Capture decorator for looped video files. The frames decoded on the first pass
+// are kept in memory, raw or as JPEG, and when the video is rewound the next passes
+// are served from memory instead of being decoded again. If the clip does not fit
+// in maxBytes, the cache is dropped and every pass is decoded as usual.
+//
+// The clip ends where the first pass was rewound, so get(CAP_PROP_FRAME_COUNT)
+// returns the number of cached frames once the cache is in use.
+class CachedCapture : public cv::VideoCapture {
+public:
+	CachedCapture(cv::Ptr<cv::VideoCapture> source, const std::string &name, size_t maxBytes, bool jpeg);
+
+	bool isOpened() const;
+	void release();
+	bool grab();
+	bool retrieve(cv::OutputArray image, int flag = 0);
+	bool read(cv::OutputArray image);
+	bool set(int propId, double value);
+	double get(int propId) const;
+
+	// Memory used by the cached frames
+	size_t cachedBytes() const
+	{
+		return bytes;
+	}
+
+private:
+	enum State {
+		Filling,     // First pass: decode and store the frames
+		Serving,     // Later passes: read the frames from memory
+		Passthrough  // Clip too large or not read from the start: decode
+	};
+
+	void drop();
+
+	cv::Ptr<cv::VideoCapture> source;
+	std::string name;
+	size_t maxBytes;
+	bool jpeg;
+	State state;
+
+	// Only one of them is used, depending on jpeg
+	std::vector<cv::Mat> frames;
+	std::vector<std::vector<unsigned char>> encoded;
+	cv::Mat decoded;
+	size_t bytes;
+
+	// Frame number of the next read, and whether the cached frames start at frame 0
+	long position;
+	bool fromStart;
+	bool grabbed;
+};
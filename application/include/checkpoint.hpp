@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int checkpointLabelLength = 32;
+
+// Counter state of one video
+struct StreamCounters {
+	char label[checkpointLabelLength];
+	int32_t totalCount;
+	int32_t lastCorrectCount;
+	int32_t frames;
+	int32_t loopFrames;
+	uint32_t historySize;   // Number of CountRecords of the video
+};
+
+// One entry of the count history of a video
+struct CountRecord {
+	int32_t frameNo;
+	int32_t count;
+	char timestamp[12];
+};
+
+// Crash-safe storage of the counters. The inference thread hands over the new
+// state with update(), which only copies it under a lock. A background thread
+// writes it every interval:
+//  - the new CountRecords are appended to counts.journal,
+//  - the counters of all the videos, with the journal size, are written to a
+//    temporary file that is renamed over counts.snapshot.
+// Both files are synced once per interval. The snapshot has a fixed size and the
+// journal only grows by the new records, so the cost does not depend on the
+// length of the history. On restore, journal records past the size saved in the
+// snapshot are dropped, so the history always matches the counters.
+class Checkpointer {
+public:
+	Checkpointer(const std::string &dir, size_t streams, int intervalMs);
+	~Checkpointer();
+
+	// Read the last checkpoint. Returns false if there is none or it does not
+	// match the current videos, in which case counting starts from zero.
+	bool restore(std::vector<StreamCounters> &counters, std::vector<std::vector<CountRecord>> &history);
+
+	// Start writing checkpoints in the background
+	void start(const std::vector<StreamCounters> &counters);
+
+	// Record the new state of a video. newRecords are the history entries added
+	// since the previous update of the video.
+	void update(size_t stream, const StreamCounters &counters, const CountRecord *newRecords, size_t numRecords);
+
+	// Write the updates made so far without waiting for the interval, and wait
+	// for the write. Returns false if it failed; it is tried again later.
+	bool flush();
+
+private:
+	struct JournalRecord {
+		uint32_t stream;
+		CountRecord record;
+	};
+
+	void run();
+	// Records that could not be appended are kept for the next interval; a
+	// snapshot that could not be written is written again at the next interval
+	bool writeJournal(const std::vector<JournalRecord> &records);
+	bool writeSnapshot(const std::vector<StreamCounters> &counters);
+
+	std::string snapshotPath;
+	std::string journalPath;
+	std::string dir;
+	size_t streams;
+	int intervalMs;
+
+	std::mutex lock;
+	std::condition_variable wake;
+	bool stopping;
+	bool dirty;
+	std::condition_variable flushed;
+	uint64_t flushRequests;
+	uint64_t flushesDone;
+	bool lastWritten;
+	std::vector<StreamCounters> pendingCounters;
+	std::vector<JournalRecord> pendingRecords;
+	std::thread writer;
+
+	int journalFd;
+	uint64_t journalSize;
+};
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+// Protocol between the inference daemon and the monitor processes using the
+// "remote" backend. Like the shared memory export, it has no dependency on OpenCV.
+//
+// A client connects to the Unix stream socket of the daemon and sends a
+// DaemonHello. The daemon answers with a DaemonWelcome, which carries as ancillary
+// data (SCM_RIGHTS) the descriptor of a shared memory object already unlinked:
+// requests slots of slotSize bytes, each holding the BGR pixels of one network
+// input, inputWidth * 3 bytes per row. The object disappears with the last
+// process that maps it, so a crash of either side leaves nothing behind.
+//
+// To infer a frame, the client writes its pixels to the slot of a request and
+// sends a DaemonSubmit. When the inference is done, the daemon sends a
+// DaemonResult followed by numDetections DaemonDetection. Results come in
+// completion order, not in submission order. A request must not be submitted
+// again before its result has been received.
+
+static const uint32_t daemonMagic = 0x44495453; // "STID"
+static const uint32_t daemonVersion = 1;
+static const uint32_t daemonMaxRequests = 64;   // Per client
+static const char daemonDefaultSocket[] = "/tmp/store-traffic-monitor.sock";
+
+struct DaemonHello {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t requests;          // Requests wanted by the client
+	float threshold;            // Minimum confidence of the detections sent back
+};
+
+struct DaemonWelcome {
+	uint32_t magic;
+	uint32_t version;
+	int32_t status;             // 0, or negative if the client is refused
+	uint32_t requests;          // Requests granted
+	uint32_t inputWidth;
+	uint32_t inputHeight;
+	uint64_t slotSize;
+	char backend[16];           // Backend used by the daemon
+};
+
+struct DaemonSubmit {
+	uint32_t request;
+};
+
+struct DaemonResult {
+	uint32_t request;
+	int32_t status;             // 0, or negative if the inference failed
+	uint32_t numDetections;
+};
+
+struct DaemonDetection {
+	int32_t label;
+	float confidence;
+	float xmin;                 // Coordinates relative to the frame size
+	float ymin;
+	float xmax;
+	float ymax;
+};
+
+// Send or receive exactly size bytes. Returns false if the connection is closed
+inline bool daemonSend(int fd, const void *data, size_t size)
+{
+	const char *p = static_cast<const char *>(data);
+	while (size > 0)
+	{
+		ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+inline bool daemonReceive(int fd, void *data, size_t size)
+{
+	char *p = static_cast<char *>(data);
+	while (size > 0)
+	{
+		ssize_t n = recv(fd, p, size, 0);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <deque>
+#include <string>
+#include <vector>
+#include "opencv2/core.hpp"
+
+// Pool of frame buffers for one video. cv::Mat is reference counted, so a buffer is
+// free once the pool holds the only reference to it. Reading a frame into a free
+// buffer of the same size reuses its memory instead of allocating a new one.
+class FramePool {
+public:
+	explicit FramePool(size_t size = 3)
+		: frames(size)
+		, next(0) {}
+
+	// Get a buffer that no one else is using. The pool grows if all the buffers
+	// are still referenced, which only happens while the pipeline warms up
+	cv::Mat &acquire()
+	{
+		for (size_t i = 0; i < frames.size(); ++i)
+		{
+			size_t idx = (next + i) % frames.size();
+			if (frames[idx].u == nullptr || frames[idx].u->refcount == 1)
+			{
+				next = (idx + 1) % frames.size();
+				return frames[idx];
+			}
+		}
+		frames.push_back(cv::Mat());
+		next = 0;
+		return frames.back();
+	}
+
+	size_t size() const
+	{
+		return frames.size();
+	}
+
+private:
+	// deque keeps the references handed out valid when the pool grows
+	std::deque<cv::Mat> frames;
+	size_t next;
+};
+
+// Log of the most recent detections. The lines are preallocated and overwritten
+// in place, so adding a line does not allocate.
+class RollingLog {
+public:
+	RollingLog(size_t capacity, size_t lineLength = 64)
+		: lines(capacity)
+		, first(0)
+		, count(0)
+	{
+		for (auto &l : lines)
+		{
+			l.reserve(lineLength);
+		}
+	}
+
+	void add(const char *line)
+	{
+		if (lines.empty())
+		{
+			return;
+		}
+		if (count < lines.size())
+		{
+			lines[(first + count) % lines.size()].assign(line);
+			++count;
+		}
+		else
+		{
+			lines[first].assign(line);
+			first = (first + 1) % lines.size();
+		}
+	}
+
+	size_t size() const
+	{
+		return count;
+	}
+
+	// i = 0 is the oldest line
+	const std::string &operator[](size_t i) const
+	{
+		return lines[(first + i) % lines.size()];
+	}
+
+private:
+	std::vector<std::string> lines;
+	size_t first;
+	size_t count;
+};
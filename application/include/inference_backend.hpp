@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "opencv2/core.hpp"
+
+// An object detected by the network. The coordinates are relative to the frame
+// size and the label is the line of the object class in the labels file.
+struct Detection {
+	int label;
+	float confidence;
+	float xmin;
+	float ymin;
+	float xmax;
+	float ymax;
+};
+
+// Settings used to create an inference backend
+struct BackendConfig {
+	std::string type;           // "ie", "dnn", "synthetic" or "remote"
+	std::string model;          // .xml IR, or any model cv::dnn can read
+	std::string weights;
+	std::string device;         // Inference Engine device
+	size_t requests = 2;        // Number of requests that can be in flight
+	size_t streams = 0;         // ie backend on the CPU: throughput streams, 0 for the device default
+	float threshold = 0.5f;     // Minimum confidence of a detection
+	size_t inputWidth = 300;    // Network input size, when the model cannot tell
+	size_t inputHeight = 300;
+	std::string script;         // Synthetic backend: JSON file with the detections to return
+	int latencyMs = 0;          // Synthetic backend: time taken by each inference
+	std::string socket;         // Remote backend: Unix socket of the inference daemon
+	float scale = 1;            // Fraction of the input size the network is reshaped to
+	std::vector<float> variants; // Scales of the networks compiled side by side, from the largest
+	float pixelScale = 0;       // dnn backend: factor of the pixels once the mean is subtracted, 0 for the model default
+	std::vector<float> mean;    // dnn backend: mean of the pixels, one or three channels, empty for the model default
+	bool swapRB = false;        // dnn backend: feed the network RGB frames instead of BGR
+};
+
+// Object detection backend with asynchronous submit/complete semantics.
+// A backend owns a fixed number of requests. A frame submitted on a request is
+// inferred in the background and its detections are collected with wait().
+// Different requests may be used from different threads at the same time.
+class InferenceBackend {
+public:
+	virtual ~InferenceBackend() {}
+
+	virtual const char *name() const = 0;
+	virtual size_t inputWidth() const = 0;
+	virtual size_t inputHeight() const = 0;
+	virtual size_t requestCount() const = 0;
+
+	// Input sizes of the variants of the network, from the largest. A frame resized
+	// to the size of any variant can be submitted. The input size of the backend is
+	// that of the first variant
+	virtual size_t variantCount() const
+	{
+		return 1;
+	}
+
+	virtual cv::Size variantSize(size_t) const
+	{
+		return cv::Size((int)inputWidth(), (int)inputHeight());
+	}
+
+	// Start the inference of a BGR frame already resized to the network input size
+	virtual void submit(size_t request, const cv::Mat &frame) = 0;
+
+	// Wait for the inference started on the request and get its detections.
+	// Returns false if no frame was submitted on the request or the inference failed.
+	virtual bool wait(size_t request, std::vector<Detection> &detections) = 0;
+};
+
+// Create the backend selected by config.type, with one network for every scale of
+// config.variants. Throws std::logic_error if the backend is unknown, not built
+// in, or the model cannot be loaded.
+std::unique_ptr<InferenceBackend> createBackend(const BackendConfig &config);
+
+std::unique_ptr<InferenceBackend> createIEBackend(const BackendConfig &config);
+std::unique_ptr<InferenceBackend> createDnnBackend(const BackendConfig &config);
+std::unique_ptr<InferenceBackend> createSyntheticBackend(const BackendConfig &config);
+std::unique_ptr<InferenceBackend> createRemoteBackend(const BackendConfig &config);
+std::unique_ptr<InferenceBackend> createVariantBackend(const BackendConfig &config);
+
+// Input size of a network reshaped by scale, a multiple of 16
+size_t scaledInputSize(size_t size, float scale);
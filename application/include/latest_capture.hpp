@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include "opencv2/core.hpp"
+#include "opencv2/videoio.hpp"
+
+// Background capture of a live source. A reader thread reads the source as fast as
+// it delivers frames and keeps only the newest one, so the driver buffer never fills
+// up with stale frames while the inference is behind. read() returns the newest
+// frame that has not been returned yet, and remembers when it was captured.
+//
+// With a watchdog timeout, a source that fails or delivers no frame for that long
+// is marked degraded and reopened in the background with an exponential backoff.
+// A reader stuck in a hung driver is abandoned, and read() waits at most one frame
+// interval, or not at all while the source is degraded, so a bad source never holds
+// up the caller.
+class LatestFrameCapture : public cv::VideoCapture {
+public:
+	typedef std::function<cv::Ptr<cv::VideoCapture>()> Opener;
+
+	// Open the source with open(). Without a timeout the capture ends with the source
+	LatestFrameCapture(Opener open, int timeoutMs = 0);
+	~LatestFrameCapture();
+
+	bool isOpened() const;
+	void release();
+	bool grab();
+	bool retrieve(cv::OutputArray image, int flag = 0);
+	bool read(cv::OutputArray image);
+	bool set(int propId, double value);
+	double get(int propId) const;
+
+	// Time at which the last returned frame was captured
+	std::chrono::steady_clock::time_point frameTime() const
+	{
+		return returnedTime;
+	}
+
+	// Frames captured but never returned, because a newer one replaced them
+	long droppedFrames() const;
+
+	// The watchdog lost the source and is reopening it
+	bool degraded() const;
+
+	// Number of times the source was reopened
+	int reconnects() const;
+
+private:
+	// Shared with the background threads, which may outlive the capture when
+	// they are stuck in a driver call
+	struct State;
+
+	static void readLoop(std::shared_ptr<State> state, cv::Ptr<cv::VideoCapture> source, long generation);
+	static void supervise(std::shared_ptr<State> state);
+
+	std::shared_ptr<State> state;
+	std::chrono::steady_clock::time_point returnedTime;
+	double fps;
+	double width;
+	double height;
+};
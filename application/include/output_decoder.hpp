@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <inference_backend.hpp>
+
+// Turns the output tensor of a detection network into detections. The decoder is
+// chosen once from the output shape when the model is loaded. Every format is a
+// separate instance of a template, so its per-proposal loop is compiled for that
+// format alone and costs a single virtual call per frame.
+//
+// A decoder keeps scratch buffers between frames: use one per request.
+class OutputDecoder {
+public:
+	virtual ~OutputDecoder() {}
+
+	virtual const char *name() const = 0;
+
+	// Decode the FP32 output of one inference. The coordinates of the detections
+	// are relative to the frame size.
+	virtual void decode(const float *output, float threshold, std::vector<Detection> &detections) = 0;
+};
+
+// Decoder of an output of shape dims, which is one of
+//   [1, 1, N, 7]             SSD DetectionOutput
+//   [1, N, 5 + classes]      YOLO with objectness, boxes in input pixels (YOLOv5)
+//   [1, 4 + classes, N]      anchor-free YOLO, boxes in input pixels (YOLOv8)
+// Throws std::logic_error for any other shape.
+std::unique_ptr<OutputDecoder> createDecoder(const std::vector<size_t> &dims, size_t inputWidth, size_t inputHeight);
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "opencv2/core.hpp"
+#include "opencv2/imgproc.hpp"
+#include <inference_backend.hpp>
+
+// Per-frame steps of the main loop. They do not depend on the VideoCap globals,
+// so the benchmarks can call them with fixed inputs.
+
+// Count history entry of the browser UI
+typedef struct
+{
+	int frameNo;
+	int count;
+	char timestamp[30];
+} frameInfo;
+
+// Count the detections of a label and draw their boxes on the frame, if any
+inline int countDetections(const std::vector<Detection> &detections, const std::vector<bool> &usedLabels,
+	int label, cv::Mat &frame, int width, int height)
+{
+	int count = 0;
+	for (const Detection &d : detections) {
+		int labelnum = d.label;
+		if (labelnum >= 0 && labelnum < (int)usedLabels.size() && usedLabels[labelnum] &&
+		(label == labelnum)) {
+			count++;
+			if (frame.empty())
+				continue;
+			float xmin = d.xmin * width;
+			float ymin = d.ymin * height;
+			float xmax = d.xmax * width;
+			float ymax = d.ymax * height;
+			cv::rectangle(frame, cv::Point((int)xmin, (int)ymin), cv::Point((int)xmax, (int)ymax),
+				cv::Scalar(0, 255, 0), 4, cv::LINE_AA, 0);
+		}
+	}
+	return count;
+}
+
+// A new count is accepted once it has been seen on `required` frames in a row.
+// Returns true on the frame where the count is confirmed
+inline bool confirmCount(int currentCount, int &candidateCount, int &candidateConfidence, int required)
+{
+	if (candidateCount == currentCount)
+		candidateConfidence++;
+	else {
+		candidateConfidence = 0;
+		candidateCount = currentCount;
+	}
+	if (candidateConfidence == required) {
+		candidateConfidence = 0;
+		return true;
+	}
+	return false;
+}
+
+// Draw the counts, the FPS and the inference time on a displayed frame. A negative
+// infer time is shown as not available (async mode). The text is formatted into the
+// reserved overlayText of the video, so no temporary strings are allocated
+inline void drawOverlay(cv::Mat &display, std::string &overlayText, const std::string &labelName,
+	int totalCount, int currentCount, float fps, float inferTime)
+{
+	char text[100];
+	int height = display.rows;
+	snprintf(text, sizeof(text), "Total %s count: %d", labelName.c_str(), totalCount);
+	overlayText.assign(text);
+	cv::putText(display, overlayText, cv::Point(10, height - 10), cv::FONT_HERSHEY_SIMPLEX,
+		0.5, cv::Scalar(255, 255, 255), 1, 8, false);
+	snprintf(text, sizeof(text), "Current %s count: %d", labelName.c_str(), currentCount);
+	overlayText.assign(text);
+	cv::putText(display, overlayText, cv::Point(10, height - 30), cv::FONT_HERSHEY_SIMPLEX,
+		0.5, cv::Scalar(255, 255, 255), 1, 8, false);
+
+	snprintf(text, sizeof(text), "FPS: %.2f", fps);
+	overlayText.assign(text);
+	cv::putText(display, overlayText, cv::Point(10, height - 50),
+		cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 1, 8, false);
+
+	if (inferTime >= 0) {
+		snprintf(text, sizeof(text), "Infer time: %.3f", inferTime);
+	} else {
+		snprintf(text, sizeof(text), "Infer time: N/A for Async mode");
+	}
+	overlayText.assign(text);
+	cv::putText(display, overlayText, cv::Point(10, height - 70),
+		cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 1, 8, false);
+}
+
+// Write the count history of one video as the members of a data.json object.
+// The times are in seconds of video
+inline void writeCountHistory(std::ostream &dataJSON, const std::vector<std::pair<int, int>> &countAtFrame,
+	double fps)
+{
+	char str[100];
+	int fsz = static_cast<int>(countAtFrame.size()) - 1;
+	for (int j = 0; j <= fsz; ++j)
+	{
+		snprintf(str, sizeof(str), "\t\t\"%.2f\" : \"%d\"%s\n", (float)countAtFrame[j].first / fps,
+			countAtFrame[j].second, j < fsz ? "," : "");
+		dataJSON << str;
+	}
+}
+
+// Same for the browser UI, keyed by frame number
+inline void writeCountHistory(std::ostream &dataJSON, const std::vector<frameInfo> &countAtFrame)
+{
+	char str[100];
+	int fsz = static_cast<int>(countAtFrame.size()) - 1;
+	for (int j = 0; j <= fsz; ++j)
+	{
+		snprintf(str, sizeof(str), "\t\t\"%d\": {\n\t\t\t\"count\":\"%d\",\n\t\t\t\"time\":\"%s\"\n\t\t}%s\n",
+			countAtFrame[j].frameNo, countAtFrame[j].count, countAtFrame[j].timestamp, j < fsz ? "," : "");
+		dataJSON << str;
+	}
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Chooses the network variant of one video from the measured load. The load of
+// a frame is the time the application worked since the previous frame of the
+// video, over the time between two frames of the video: above 1 the video falls
+// behind, its camera drops frames or its file plays slower than real time. In
+// live mode the capture to count latency counts as well.
+//
+// The smoothed load moves the video to the next smaller variant when it goes
+// above 1, and back to the larger one when the load predicted for it, scaled by
+// the pixel count of the variants, is below 0.8. After a switch the variant is
+// kept for 2 seconds, so the load settles before the next decision.
+class ResolutionController {
+public:
+	ResolutionController() {}
+
+	// cost: number of input pixels of every variant, from the largest. frameMs:
+	// time between two frames of the video
+	ResolutionController(const std::vector<double> &cost, double frameMs);
+
+	// Feed the measurements of a processed frame of the video: the time worked
+	// since its previous frame and, in live mode, its latency (0 otherwise).
+	// Returns true when the variant changes
+	bool update(double busyMs, double latencyMs);
+
+	size_t variants() const
+	{
+		return cost.size();
+	}
+
+	size_t variant() const
+	{
+		return current;
+	}
+
+	double load() const
+	{
+		return smoothed;
+	}
+
+	int switches() const
+	{
+		return switchCount;
+	}
+
+private:
+	std::vector<double> cost;
+	double frameMs = 0;
+	long holdFrames = 0;
+	double smoothed = 0;
+	size_t current = 0;
+	long frames = 0;
+	long framesSinceSwitch = 0;
+	int switchCount = 0;
+};
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "opencv2/core.hpp"
+
+#include <inference_backend.hpp>
+#include <shm_layout.hpp>
+
+// Writer side of the shared memory ring buffer of a video, see shm_layout.hpp.
+// The shared memory object is created on the first frame, with room for frames
+// of that size, and removed when the exporter is destroyed.
+class ShmExporter {
+public:
+	ShmExporter(const std::string &name, const std::string &camName, const std::string &labelName,
+	            int label, int slotCount = 4);
+	~ShmExporter();
+
+	const std::string &name() const
+	{
+		return shmName;
+	}
+
+	// Publish a frame with the detections of the video's label. Frames larger
+	// than the first one are published without pixels.
+	void publish(const cv::Mat &frame, const std::vector<Detection> &detections,
+	             int currentCount, int totalCount);
+
+private:
+	ShmExporter(const ShmExporter &);
+	ShmExporter &operator=(const ShmExporter &);
+
+	bool create(int width, int height);
+
+	std::string shmName;
+	std::string camName;
+	std::string labelName;
+	int label;
+	int slotCount;
+	bool failed;
+	ShmHeader *header;
+	size_t size;
+	uint64_t frames;
+};
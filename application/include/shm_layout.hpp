@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Layout of the shared memory ring buffer that publishes the frames and
+// detections of one video. The layout has no dependency on OpenCV, so consumers
+// only need this header.
+//
+// The memory starts with a ShmHeader followed by slotCount slots of slotSize
+// bytes. Each slot is a ShmSlot followed by the BGR pixels of the frame.
+//
+// There is a single writer. Frame n (starting from 1) goes to slot n % slotCount.
+// The seq of the slot is 2n - 1 while the writer fills it and 2n when it is
+// complete, then the latest field of the header is set to n. A reader takes
+// latest, checks that the seq of its slot is 2n, reads the slot in place and
+// checks seq again: if it changed, the writer has reused the slot meanwhile and
+// the data must be discarded. Readers never block the writer.
+
+static const uint32_t shmMagic = 0x314d5453; // "STM1"
+static const uint32_t shmVersion = 1;
+static const int shmMaxDetections = 64;
+static const int shmNameLength = 32;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "Shared memory export needs lock-free 64-bit atomics");
+
+struct ShmDetection {
+	float confidence;
+	float xmin;     // Coordinates relative to the frame size
+	float ymin;
+	float xmax;
+	float ymax;
+};
+
+struct ShmHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slotCount;
+	uint32_t headerSize;        // Offset of the first slot
+	uint64_t slotSize;
+	uint32_t pixelOffset;       // Offset of the pixels from the start of a slot
+	uint32_t maxWidth;
+	uint32_t maxHeight;
+	int32_t label;
+	char labelName[shmNameLength];
+	char camName[shmNameLength];
+	std::atomic<uint64_t> latest;   // Last published frame, 0 if none
+	int32_t ownerPid;           // Process of the writer
+};
+
+struct ShmSlot {
+	std::atomic<uint64_t> seq;
+	int64_t timestampUs;        // Wall clock time, microseconds since the epoch
+	int32_t width;
+	int32_t height;
+	int32_t step;               // Bytes per row of pixels
+	int32_t currentCount;
+	int32_t totalCount;
+	int32_t numDetections;
+	ShmDetection detections[shmMaxDetections];
+};
+
+inline ShmSlot *shmSlot(ShmHeader *header, uint64_t frame)
+{
+	return reinterpret_cast<ShmSlot *>(reinterpret_cast<char *>(header) + header->headerSize +
+		(frame % header->slotCount) * header->slotSize);
+}
+
+inline uint8_t *shmPixels(ShmHeader *header, ShmSlot *slot)
+{
+	return reinterpret_cast<uint8_t *>(slot) + header->pixelOffset;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include "opencv2/videoio.hpp"
+
+// Objects drawn by the synthetic source have this value in the green channel,
+// and their label + 1 in the blue channel, so the synthetic backend can detect
+// them without running a network.
+static const int syntheticObjectLevel = 255;
+
+// Video source that generates its frames in memory: moving rectangles on a black
+// background. It is opened from a URL of the form
+//
+//   synthetic://WIDTHxHEIGHT@FPS/PATTERN?objects=N&frames=M&seed=S
+//
+// where PATTERN is "static", "bounce" (objects bounce off the borders) or "walk"
+// (objects cross the frame from left to right and come back later). All the parts
+// are optional. With frames=0, the default, the source never ends. The object
+// positions depend only on the frame number, so seeking is supported. A paced
+// source delivers its frames at its FPS, like a camera, otherwise as fast as
+// they are read.
+class SyntheticCapture : public cv::VideoCapture {
+public:
+	explicit SyntheticCapture(const std::string &url);
+
+	// Label encoded in the objects, set once the labels file has been read
+	void setLabel(int label);
+
+	void setPaced(bool paced);
+
+	// cv::VideoCapture interface
+	bool isOpened() const override;
+	void release() override;
+	bool grab() override;
+	bool retrieve(cv::OutputArray image, int flag = 0) override;
+	bool read(cv::OutputArray image) override;
+	bool set(int propId, double value) override;
+	double get(int propId) const override;
+
+	static bool isSyntheticUrl(const std::string &url);
+
+private:
+	struct Object {
+		float x;
+		float y;
+		float vx;
+		float vy;
+		int width;
+		int height;
+	};
+
+	cv::Rect objectAt(const Object &obj, long frameNo) const;
+
+	bool opened;
+	int width;
+	int height;
+	double fps;
+	std::string pattern;
+	long frameCount;
+	long frameNo;   // Number of the next frame to be grabbed
+	int label;
+	bool paced;
+	std::chrono::steady_clock::time_point nextFrameTime;
+	std::vector<Object> objects;
+};
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Timeline tracing of the pipeline stages, written as a Chrome trace JSON file that
+// can be opened in Perfetto (ui.perfetto.dev) or chrome://tracing.
+//
+// Every thread records its events into its own buffer: appending an event takes no
+// lock and does not allocate, except for a new chunk every traceChunkEvents events.
+// When tracing is off, a TRACE_SCOPE costs one relaxed atomic load.
+
+extern std::atomic<bool> traceActive;
+
+// Start recording, keeping at most maxEvents events over all the threads
+void traceStart(size_t maxEvents);
+
+// Stop recording. The events already recorded are kept for traceWrite()
+void traceStop();
+
+// Write the recorded events. Returns false if the file cannot be written
+bool traceWrite(const std::string &path);
+
+// Name of the calling thread in the trace. The name must be a string literal
+void traceThreadName(const char *name);
+
+// Record a stage that started at begin, tagged by stream and frame (-1 if none)
+void traceEvent(const char *name, int64_t begin, int64_t end, int stream, int frame);
+
+int64_t traceNow();
+
+// Records the enclosing scope as a stage. The name must be a string literal
+class TraceScope {
+public:
+	TraceScope(const char *name, int stream = -1, int frame = -1)
+		: name(name)
+		, stream(stream)
+		, frame(frame)
+		, begin(traceActive.load(std::memory_order_relaxed) ? traceNow() : -1) {}
+
+	~TraceScope()
+	{
+		if (begin >= 0)
+		{
+			traceEvent(name, begin, traceNow(), stream, frame);
+		}
+	}
+
+private:
+	const char *name;
+	int stream;
+	int frame;
+	int64_t begin;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(traceScope, __LINE__)(__VA_ARGS__)
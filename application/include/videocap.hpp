@@ -27,6 +27,15 @@
 #include <vector>
 #include <utility>
 #include "opencv2/highgui/highgui.hpp"
+#include <memory>
+#include <framepool.hpp>
+#include <pipeline.hpp>
+#include <aggregator.hpp>
+#include <shm_export.hpp>
+#include <latest_capture.hpp>
+#include <cached_capture.hpp>
+#include <inference_backend.hpp>
+#include <resolution_controller.hpp>
 
 
 #include <ctime>
@@ -41,9 +50,40 @@ static string conf_binFilePath;
 static string conf_labelsFilePath;
 static const string conf_file = "../resources/config.json";
 static const size_t conf_batchSize = 1;
+static string conf_backend;
+static string conf_syntheticScript;
+static bool conf_shmExport = false;
+static string conf_checkpointDir;
+static int conf_checkpointInterval = 5; // seconds
+static int conf_syntheticLatency = 0;
+static string conf_daemonSocket = "/tmp/store-traffic-monitor.sock"; // used by the remote backend
+static size_t conf_inputWidth = 300;  // Input size for backends that cannot read it from the model
+static size_t conf_inputHeight = 300;
+static float conf_pixelScale = 0; // dnn backend preprocessing, 0 and empty for the defaults of the model
+static vector<float> conf_meanValues;
+static bool conf_swapRB = false;
+static bool conf_liveMode = false;
+static int conf_maxFrameAge = 0; // milliseconds, 0 for no limit
+static string conf_traceFile;
+static int conf_traceDuration = 0; // seconds, 0 to trace until the end
+static const size_t conf_traceEvents = 1000000; // about 32 MB
+static int conf_watchdogTimeout = 0; // seconds without a frame before a stream is reopened, 0 for no watchdog
+static size_t conf_frameCacheSize = 0; // megabytes per looped video, 0 to decode every loop
+static bool conf_frameCacheJpeg = false;
+static vector<float> conf_resolutionScales; // network variants, empty for the input size of the model only
+static string conf_batchInput; // directory or list file of the videos counted offline
+static int conf_batchWorkers = 0; // 0 for one per CPU core
+static string conf_batchOutput = "batch_results";
+static string conf_batchLabel = "person";
 
 int numVideos = 20000;
 bool loopVideos = false;
+
+// Replay mode processes every frame of the input files in a fixed order and takes
+// the timestamps from the video timeline, so the count results are reproducible
+bool replayMode = false;
+static string conf_replayFile;
+static string conf_goldenFile;
 #ifndef UI_OUTPUT
 static const int conf_windowColumns = 3; // OpenCV windows per each row
 #endif
@@ -56,19 +96,13 @@ static std::vector<std::string> acceptedDevices{"CPU", "GPU", "MYRIAD", "HETERO:
 static const string conf_videoDir = "../UI/resources/video_frames/";
 static const string conf_dataJSON_file = "../UI/resources/video_data/data.json";
 static const string conf_videJSON_file = "../UI/resources/video_data/videolist.json";
+static const string conf_summaryJSON_file = "../UI/resources/video_data/summary.json";
 #else
 //static const int conf_fourcc = 0x00000021; 
 static const string conf_dataJSON_file = "data.json";
+static const string conf_summaryJSON_file = "summary.json";
 #endif
-
-#ifdef UI_OUTPUT
-typedef struct
-{
-	int frameNo;
-	int count;
-	char timestamp[30];
-} frameInfo;
-#endif
+static const int conf_summaryInterval = 1; // seconds between two summary.json updates
 
 class VideoCap {
 public:
@@ -77,6 +111,11 @@ public:
 
 	string labelName;
 	int label;
+
+	// Model that detects the objects of this video, see DetectionModel
+	string modelName;
+	size_t model = 0;
+
 	cv::Mat frame;
 	int lastCorrectCount;
 	int totalCount;
@@ -90,13 +129,14 @@ public:
 	std::chrono::high_resolution_clock::time_point t2;
 	float fps;
 
-	cv::VideoCapture vc;
+	cv::Ptr<cv::VideoCapture> vc;
 #ifndef UI_OUTPUT
 	cv::VideoWriter vw;
 #endif
 	int frames = 0;
 	int loopFrames = 0;
 	bool isCam = false;
+	bool headless = false;   // No window and no output video, for the synthetic sources
 
 	const string camName;
 #ifndef UI_OUTPUT
@@ -110,6 +150,48 @@ public:
 	vector<pair<int, int>> countAtFrame;
 #endif
 
+	// Buffers reused on every frame, so that the main loop does not allocate
+	// once it has warmed up
+	FramePool framePool;
+	cv::Mat display;
+	cv::Mat endMessage;
+	string overlayText;
+
+	// Shared memory export of the frames and detections, when enabled
+	std::shared_ptr<ShmExporter> shm;
+
+	// Number of countAtFrame entries already handed to the checkpointer
+	size_t checkpointedHistory = 0;
+
+	// Windowed statistics of the count for the dashboards
+	CountAggregator aggregator;
+
+	// Live mode capture of a camera, owned by vc
+	LatestFrameCapture *live = nullptr;
+
+	// Background capture of a camera under the watchdog, owned by vc, and whether
+	// it was lost the last time it was checked
+	LatestFrameCapture *watched = nullptr;
+	bool degraded = false;
+	cv::Mat degradedMessage;
+	std::chrono::steady_clock::time_point frameTime;
+
+	// Capture to count latency in live mode, in milliseconds, and the frames
+	// discarded because they were older than conf_maxFrameAge
+	double latency = 0;
+	double latencySum = 0;
+	double latencyMax = 0;
+	long latencyFrames = 0;
+	long staleFrames = 0;
+
+	// Network variant chosen for the load of this video and its input size. The
+	// load is measured from the time and the idle time of the main loop at the
+	// previous processed frame of the video
+	ResolutionController resolution;
+	cv::Size networkInput;
+	std::chrono::steady_clock::time_point resolutionTime;
+	double resolutionIdle = 0;
+
 	// Constructor for video input
 	VideoCap(size_t inputWidth,
 			 size_t inputHeight,
@@ -125,19 +207,22 @@ public:
 		, candidateCount(0)
 		, frame()
 		, candidateConfidence(0)
-		, vc(inputVideo.c_str())
+		, vc(cv::makePtr<cv::VideoCapture>(inputVideo.c_str()))
 		, camName(camName)
 #ifndef UI_OUTPUT
 		, videoName(camName + ".mp4")
 #endif
 		, labelName(labelName) {
-			if (!vc.isOpened())
+			if (!vc->isOpened())
 			{
 				std::cout << "Couldn't open video " << inputVideo << std::endl;
 				exit(1);
 			}
+			countAtFrame.reserve(1024);
+			overlayText.reserve(128);
 #ifndef UI_OUTPUT
-			cv::namedWindow(camName);
+			if (!replayMode)
+				cv::namedWindow(camName);
 #endif
 		}
 		
@@ -154,31 +239,90 @@ public:
 		, changedCount(0)
 		, candidateCount(0)
 		, candidateConfidence(0)
-		, vc(inputVideo)
+		, vc(cv::makePtr<cv::VideoCapture>(inputVideo))
 		, camName(camName)
 #ifndef UI_OUTPUT
 		, videoName(camName + "_inferred.mp4")
 #endif
 		, labelName(labelName) {
-			if (!vc.isOpened())
+			if (!vc->isOpened())
 			{
 				std::cout << "Couldn't open video " << inputVideo << std::endl;
 				exit(1);
 			}
+			countAtFrame.reserve(1024);
+			overlayText.reserve(128);
 #ifndef UI_OUTPUT
-			cv::namedWindow(camName);
+			if (!replayMode)
+				cv::namedWindow(camName);
 #endif
 			isCam = true;
 		}
+
+	// Constructor for a source that generates its own frames. Sources without
+	// an end are treated like cameras. They are meant for load tests, so they
+	// are neither shown nor recorded
+	VideoCap(size_t inputWidth,
+			 size_t inputHeight,
+			 cv::Ptr<cv::VideoCapture> source,
+			 const string camName,
+			 const string labelName)
+		: inputWidth(inputWidth)
+		, inputHeight(inputHeight)
+		, lastCorrectCount(0)
+		, totalCount(0)
+		, currentCount(0)
+		, changedCount(0)
+		, candidateCount(0)
+		, candidateConfidence(0)
+		, vc(source)
+		, camName(camName)
+#ifndef UI_OUTPUT
+		, videoName(camName + "_inferred.mp4")
+#endif
+		, labelName(labelName) {
+			if (!vc->isOpened())
+			{
+				std::cout << "Couldn't open video source for " << camName << std::endl;
+				exit(1);
+			}
+			countAtFrame.reserve(1024);
+			overlayText.reserve(128);
+			isCam = vc->get(cv::CAP_PROP_FRAME_COUNT) <= 0;
+#ifndef UI_OUTPUT
+			headless = true;
+#endif
+		}
 		
 #ifndef UI_OUTPUT
-	int initVW(int height, int width, int fps)
+	bool initVW(int height, int width, int fps)
 	{
 		vw.open(videoName, VideoWriter::fourcc('m','p','4','v'), fps, cv::Size(width, height), true);
-		if (!vw.isOpened())
-		{
-			return 1;
-		}
+		return vw.isOpened();
 	}
 #endif
 };
+
+// A model loaded once and shared by all the videos that use it. Every model has
+// its own backend and requests, so in async mode each model keeps a frame in
+// flight while the result of its previous frame is shown
+struct DetectionModel {
+	string name;
+	string labelsFile;
+	BackendConfig config;
+	std::unique_ptr<InferenceBackend> backend;
+
+	// Labels of the labels file that are counted by at least one video
+	std::vector<bool> usedLabels;
+
+	// Pipeline state: the frame submitted on nextReq is collected on currReq
+	// at the next frame of this model
+	size_t currReq = 0;
+	size_t nextReq = 1;
+	VideoCap *prevVideoCap = nullptr;
+	cv::Mat frameInfer;
+	cv::Mat prev_frame;
+	std::chrono::steady_clock::time_point prevFrameTime;
+	int prevFrameNo = 0;
+	vector<Detection> detections;
+};
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <aggregator.hpp>
+
+CountAggregator::CountAggregator(double occupancyWindow, double entryWindow,
+                                 double bucketLength, size_t maxBuckets)
+	: occupancyWindow(occupancyWindow)
+	, entryWindow(entryWindow)
+	, bucketSeconds(bucketLength)
+	, maxBuckets(maxBuckets)
+	, started(false)
+	, firstTime(0)
+	, lastTime(0)
+	, count(0)
+	, total(0)
+	, overallPeak(0)
+	, closedArea(0)
+	, entriesSum(0) {}
+
+void CountAggregator::update(double now, int newCount, int newTotal)
+{
+	if (!started)
+	{
+		started = true;
+		firstTime = now;
+		lastTime = now;
+		total = newTotal;
+		Segment s = {now, std::numeric_limits<double>::infinity(), 0};
+		segments.push_back(s);
+		peaks.push_back(s);
+		Bucket b = {(long)std::floor(now / bucketSeconds), 0, 0};
+		hourly.push_back(b);
+	}
+	now = std::max(now, lastTime);
+	advance(now);
+
+	if (newTotal > total)
+	{
+		Entry e = {now, newTotal - total};
+		entries.push_back(e);
+		entriesSum += e.entries;
+		hourly.back().entries += e.entries;
+	}
+	total = newTotal;
+
+	if (newCount != count)
+	{
+		// Close the open segment and start a new one
+		Segment &open = segments.back();
+		closedArea += (now - open.start) * open.count;
+		Segment s = {now, std::numeric_limits<double>::infinity(), newCount};
+		segments.push_back(s);
+
+		peaks.back().end = now;
+		while (!peaks.empty() && peaks.back().count <= newCount)
+		{
+			peaks.pop_back();
+		}
+		peaks.push_back(s);
+
+		count = newCount;
+		overallPeak = std::max(overallPeak, count);
+		hourly.back().peak = std::max(hourly.back().peak, count);
+	}
+}
+
+// Drop what fell out of the windows and roll the buckets over
+void CountAggregator::advance(double now)
+{
+	lastTime = now;
+
+	double occupancyStart = now - occupancyWindow;
+	while (segments.size() > 1 && segments[1].start <= occupancyStart)
+	{
+		closedArea -= (segments[1].start - segments[0].start) * segments[0].count;
+		segments.pop_front();
+	}
+	while (peaks.size() > 1 && peaks.front().end <= occupancyStart)
+	{
+		peaks.pop_front();
+	}
+
+	double entryStart = now - entryWindow;
+	while (!entries.empty() && entries.front().time <= entryStart)
+	{
+		entriesSum -= entries.front().entries;
+		entries.pop_front();
+	}
+
+	long index = (long)std::floor(now / bucketSeconds);
+	if (index != hourly.back().index)
+	{
+		Bucket b = {index, 0, count};
+		hourly.push_back(b);
+		while (hourly.size() > maxBuckets + 1)
+		{
+			hourly.pop_front();
+		}
+	}
+}
+
+double CountAggregator::averageOccupancy(double now)
+{
+	if (!started)
+	{
+		return 0;
+	}
+	now = std::max(now, lastTime);
+	advance(now);
+
+	double windowStart = std::max(now - occupancyWindow, firstTime);
+	if (now <= windowStart)
+	{
+		return count;
+	}
+	const Segment &front = segments.front();
+	const Segment &open = segments.back();
+	double area = closedArea + (now - open.start) * open.count;
+	if (front.start < windowStart)
+	{
+		area -= (windowStart - front.start) * front.count;
+	}
+	return area / (now - windowStart);
+}
+
+int CountAggregator::windowPeak(double now)
+{
+	if (!started)
+	{
+		return 0;
+	}
+	advance(std::max(now, lastTime));
+	return peaks.front().count;
+}
+
+int CountAggregator::windowEntries(double now)
+{
+	if (!started)
+	{
+		return 0;
+	}
+	advance(std::max(now, lastTime));
+	return entriesSum;
+}
+
+const std::deque<CountAggregator::Bucket> &CountAggregator::buckets(double now)
+{
+	if (started)
+	{
+		advance(std::max(now, lastTime));
+	}
+	return hourly;
+}
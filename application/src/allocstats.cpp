@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "opencv2/core.hpp"
+
+#include <allocstats.hpp>
+
+static std::atomic<size_t> allocCount(0);
+static std::atomic<size_t> allocBytes(0);
+static thread_local bool trackThread = false;
+static thread_local bool paused = false;
+
+static inline void countAlloc(size_t size)
+{
+	if (trackThread && !paused)
+	{
+		allocCount++;
+		allocBytes += size;
+	}
+}
+
+void *operator new(size_t size)
+{
+	countAlloc(size);
+	void *p = malloc(size ? size : 1);
+	if (!p)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+// cv::Mat buffers come from cv::fastMalloc, not from operator new, so they are
+// counted by a Mat allocator that forwards to the default one
+class CountingMatAllocator : public cv::MatAllocator {
+public:
+	CountingMatAllocator(cv::MatAllocator *parent)
+		: parent(parent) {}
+
+	cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+	                       int flags, int usageFlags) const
+	{
+		if (!data)
+		{
+			size_t size = CV_ELEM_SIZE(type);
+			for (int i = 0; i < dims; ++i)
+			{
+				size *= sizes[i];
+			}
+			countAlloc(size);
+		}
+		return parent->allocate(dims, sizes, type, data, step, flags, usageFlags);
+	}
+
+	bool allocate(cv::UMatData *data, int accessflags, int usageFlags) const
+	{
+		return parent->allocate(data, accessflags, usageFlags);
+	}
+
+	void deallocate(cv::UMatData *data) const
+	{
+		parent->deallocate(data);
+	}
+
+private:
+	cv::MatAllocator *parent;
+};
+
+void allocStatsTrackThread()
+{
+	static CountingMatAllocator matAllocator(cv::Mat::getStdAllocator());
+	cv::Mat::setDefaultAllocator(&matAllocator);
+	trackThread = true;
+}
+
+void allocStatsSetPaused(bool pause)
+{
+	paused = pause;
+}
+
+size_t allocStatsCount()
+{
+	return allocCount;
+}
+
+size_t allocStatsBytes()
+{
+	return allocBytes;
+}
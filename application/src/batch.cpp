@@ -0,0 +1,375 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <nlohmann/json.hpp>
+#include "opencv2/imgproc.hpp"
+#include "opencv2/videoio.hpp"
+
+#include <batch.hpp>
+#include <pipeline.hpp>
+#include <trace.hpp>
+
+using json = nlohmann::json;
+
+static const char *videoExtensions[] = {".mp4", ".avi", ".mkv", ".mov", ".m4v", ".ts", ".webm", ".h264", ".h265"};
+
+// Result of one file of the batch
+struct BatchResult {
+	std::string file;
+	bool ok = false;
+	std::string error;  // Why the file failed
+	long frames = 0;
+	double videoSeconds = 0;
+	double processingSeconds = 0;
+	int totalCount = 0;
+	int peak = 0;
+	std::vector<std::pair<int, int>> countAtFrame;
+	double fps = 0;
+};
+
+static bool isVideoFile(const std::string &name)
+{
+	size_t pos = name.rfind('.');
+	if (pos == std::string::npos)
+	{
+		return false;
+	}
+	std::string ext = name.substr(pos);
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	for (const char *e : videoExtensions)
+	{
+		if (ext == e)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Video files of a directory and its subdirectories, in name order
+static void listVideos(const std::string &dir, std::vector<std::string> &files)
+{
+	DIR *d = opendir(dir.c_str());
+	if (!d)
+	{
+		return;
+	}
+	std::vector<std::string> names;
+	while (struct dirent *entry = readdir(d))
+	{
+		std::string name = entry->d_name;
+		if (name != "." && name != "..")
+		{
+			names.push_back(name);
+		}
+	}
+	closedir(d);
+	std::sort(names.begin(), names.end());
+
+	for (const std::string &name : names)
+	{
+		std::string path = dir + "/" + name;
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0)
+		{
+			continue;
+		}
+		if (S_ISDIR(st.st_mode))
+		{
+			listVideos(path, files);
+		}
+		else if (isVideoFile(name))
+		{
+			files.push_back(path);
+		}
+	}
+}
+
+static std::vector<std::string> getBatchFiles(const std::string &input)
+{
+	std::vector<std::string> files;
+	struct stat st;
+	if (stat(input.c_str(), &st) != 0)
+	{
+		return files;
+	}
+	if (S_ISDIR(st.st_mode))
+	{
+		listVideos(input, files);
+		return files;
+	}
+	std::ifstream list(input);
+	std::string line;
+	while (getline(list, line))
+	{
+		if (!line.empty() && line[0] != '#')
+		{
+			files.push_back(line);
+		}
+	}
+	return files;
+}
+
+// Position of the counted label in the labels file
+static std::vector<bool> getBatchLabels(const BatchConfig &config, int &label)
+{
+	std::vector<bool> usedLabels;
+	std::ifstream labelsFile(config.labelsFile);
+	std::string line;
+	label = -1;
+	while (getline(labelsFile, line))
+	{
+		usedLabels.push_back(line == config.label);
+		if (line == config.label && label < 0)
+		{
+			label = (int)usedLabels.size() - 1;
+		}
+	}
+	return usedLabels;
+}
+
+// Name of the result file of a video: its path with the directories flattened, so
+// that cam1.mp4 of two stores do not overwrite each other
+static std::string resultName(const BatchConfig &config, const std::string &file)
+{
+	std::string name = file;
+	if (name.compare(0, config.input.size(), config.input) == 0)
+	{
+		name = name.substr(config.input.size());
+	}
+	name.erase(0, name.find_first_not_of("./"));
+	std::replace(name.begin(), name.end(), '/', '_');
+	return name + ".json";
+}
+
+// Count the objects of one file, frame by frame, like the interactive mode does
+static void processFile(const std::string &file, size_t request, InferenceBackend &backend,
+	const std::vector<bool> &usedLabels, int label, int candidateConfidence, BatchResult &result)
+{
+	result.file = file;
+	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+	cv::VideoCapture vc(file);
+	if (!vc.isOpened())
+	{
+		result.error = "could not be read";
+		return;
+	}
+	result.fps = vc.get(cv::CAP_PROP_FPS);
+
+	cv::Mat frame;
+	cv::Mat frameInfer;
+	cv::Mat noDrawing;
+	std::vector<Detection> detections;
+	detections.reserve(256);
+	int candidateCount = 0;
+	int candidateConfidenceCount = 0;
+	int lastCorrectCount = 0;
+	for (;;)
+	{
+		{
+			TRACE_SCOPE("batch read", (int)request, (int)result.frames);
+			if (!vc.read(frame) || frame.empty())
+			{
+				break;
+			}
+		}
+		{
+			TRACE_SCOPE("batch infer", (int)request, (int)result.frames);
+			cv::resize(frame, frameInfer, cv::Size(backend.inputWidth(), backend.inputHeight()));
+			backend.submit(request, frameInfer);
+			if (!backend.wait(request, detections))
+			{
+				// The counts of the file would miss frames
+				result.error = "inference failed at frame " + std::to_string(result.frames);
+				return;
+			}
+		}
+		int currentCount = countDetections(detections, usedLabels, label, noDrawing, frame.cols, frame.rows);
+		if (confirmCount(currentCount, candidateCount, candidateConfidenceCount, candidateConfidence) &&
+		    currentCount != lastCorrectCount)
+		{
+			if (currentCount > lastCorrectCount)
+			{
+				result.totalCount += currentCount - lastCorrectCount;
+			}
+			result.peak = std::max(result.peak, currentCount);
+			result.countAtFrame.emplace_back((int)result.frames, currentCount);
+			lastCorrectCount = currentCount;
+		}
+		result.frames++;
+	}
+	result.ok = result.frames > 0;
+	if (!result.ok)
+	{
+		result.error = "could not be read";
+	}
+	result.videoSeconds = result.fps > 0 ? result.frames / result.fps : 0;
+	result.processingSeconds = std::chrono::duration_cast<std::chrono::duration<double>>(
+		std::chrono::steady_clock::now() - t1).count();
+}
+
+static bool writeResult(const BatchConfig &config, const BatchResult &result)
+{
+	json counts = json::array();
+	for (auto &c : result.countAtFrame)
+	{
+		counts.push_back({{"frame", c.first}, {"time", result.fps > 0 ? c.first / result.fps : 0},
+			{"count", c.second}});
+	}
+	json out = {
+		{"file", result.file},
+		{"label", config.label},
+		{"frames", result.frames},
+		{"videoSeconds", result.videoSeconds},
+		{"processingSeconds", result.processingSeconds},
+		{"total", result.totalCount},
+		{"peak", result.peak},
+		{"counts", counts}
+	};
+	std::ofstream f(config.outputDir + "/" + resultName(config, result.file));
+	f << out.dump(1, '\t');
+	return f.good();
+}
+
+int runBatch(const BatchConfig &config, InferenceBackend &backend)
+{
+	std::vector<std::string> files = getBatchFiles(config.input);
+	if (files.empty())
+	{
+		std::cout << "No video files found in " << config.input << std::endl;
+		return 19;
+	}
+	int label;
+	std::vector<bool> usedLabels = getBatchLabels(config, label);
+	if (label < 0)
+	{
+		std::cout << "Label " << config.label << " is not in " << config.labelsFile << std::endl;
+		return 19;
+	}
+	if (mkdir(config.outputDir.c_str(), 0755) != 0 && errno != EEXIST)
+	{
+		std::cout << "Could not create " << config.outputDir << std::endl;
+		return 19;
+	}
+	size_t workers = std::min(config.workers, std::min(files.size(), backend.requestCount()));
+	std::cout << "Processing " << files.size() << " files with " << workers << " workers" << std::endl;
+
+	// Every worker takes the next file; the results are kept in file order
+	std::vector<BatchResult> results(files.size());
+	std::atomic<size_t> nextFile(0);
+	std::mutex outputMutex;
+	size_t done = 0;
+	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+	std::vector<std::thread> pool;
+	for (size_t w = 0; w < workers; ++w)
+	{
+		pool.emplace_back([&, w]() {
+			traceThreadName("batch worker");
+			for (size_t i = nextFile++; i < files.size(); i = nextFile++)
+			{
+				BatchResult &result = results[i];
+				{
+					TRACE_SCOPE("batch file", (int)w, (int)i);
+					// A failing file must not stop the other workers
+					try
+					{
+						processFile(files[i], w, backend, usedLabels, label, config.candidateConfidence, result);
+					}
+					catch (const std::exception &e)
+					{
+						result.ok = false;
+						result.error = std::string("inference failed: ") + e.what();
+					}
+				}
+				bool written = result.ok && writeResult(config, result);
+
+				std::lock_guard<std::mutex> guard(outputMutex);
+				++done;
+				std::cout << "[" << done << "/" << files.size() << "] " << files[i] << ": ";
+				if (!result.ok)
+				{
+					std::cout << result.error << std::endl;
+					continue;
+				}
+				std::cout << result.frames << " frames, total count " << result.totalCount << ", "
+					<< (int)(result.frames / std::max(result.processingSeconds, 1e-9)) << " fps"
+					<< (written ? "" : ", results not written") << std::endl;
+			}
+		});
+	}
+	for (auto &t : pool)
+	{
+		t.join();
+	}
+	double seconds = std::chrono::duration_cast<std::chrono::duration<double>>(
+		std::chrono::steady_clock::now() - t1).count();
+
+	long frames = 0;
+	double videoSeconds = 0;
+	json summaryFiles = json::array();
+	json failed = json::array();
+	for (const BatchResult &r : results)
+	{
+		if (!r.ok)
+		{
+			failed.push_back({{"file", r.file}, {"error", r.error}});
+			continue;
+		}
+		frames += r.frames;
+		videoSeconds += r.videoSeconds;
+		summaryFiles.push_back({{"file", r.file}, {"result", resultName(config, r.file)}, {"frames", r.frames},
+			{"total", r.totalCount}, {"peak", r.peak}});
+	}
+	json summary = {
+		{"label", config.label},
+		{"workers", workers},
+		{"files", summaryFiles},
+		{"failed", failed},
+		{"frames", frames},
+		{"videoSeconds", videoSeconds},
+		{"processingSeconds", seconds},
+		{"framesPerSecond", seconds > 0 ? frames / seconds : 0},
+		{"realtimeFactor", seconds > 0 ? videoSeconds / seconds : 0}
+	};
+	std::ofstream summaryFile(config.outputDir + "/summary.json");
+	summaryFile << summary.dump(1, '\t');
+
+	std::cout << "Processed " << frames << " frames of " << results.size() - failed.size() << " files in "
+		<< seconds << " s: " << (seconds > 0 ? frames / seconds : 0) << " fps, "
+		<< (seconds > 0 ? videoSeconds / seconds : 0) << "x real time" << std::endl;
+	return failed.empty() ? 0 : 20;
+}
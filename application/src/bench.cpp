@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+// Microbenchmarks of the per-frame steps of the main loop. Every step runs on
+// fixed inputs, so the numbers of two builds can be compared directly.
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "opencv2/core.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/dnn.hpp"
+#ifdef HAVE_INFERENCE_ENGINE
+#include <inference_engine.hpp>
+#include <samples/ocv_common.hpp>
+#endif
+
+#include <allocstats.hpp>
+#include <inference_backend.hpp>
+#include <output_decoder.hpp>
+#include <pipeline.hpp>
+
+using namespace std;
+using namespace cv;
+
+static int conf_iterations = 1000;
+static string conf_filter;
+static const char *conf_benchFile = "bench.json";
+
+// Same sizes as a 720p input video and the 300x300 input of mobilenet-ssd
+static const int conf_frameWidth = 1280;
+static const int conf_frameHeight = 720;
+static const int conf_inferWidth = 300;
+static const int conf_inferHeight = 300;
+static const int conf_maxProposalCount = 100;
+// Output of a 640x640 YOLO with 80 classes
+static const int conf_yoloSize = 640;
+static const int conf_yoloBoxes = 8400;
+static const int conf_yoloClasses = 80;
+static const int conf_historySize = 10000;
+
+void parseArgs (int argc, char **argv)
+{
+	std::vector<string> allArgs(argv, argv + argc);
+
+	for (size_t i = 1; i < allArgs.size(); ++i)
+	{
+		if (i + 1 < allArgs.size() && (allArgs[i] == "-i" || allArgs[i] == "--iterations"))
+		{
+			conf_iterations = atoi(allArgs[++i].c_str());
+		}
+		else if (i + 1 < allArgs.size() && (allArgs[i] == "-f" || allArgs[i] == "--filter"))
+		{
+			conf_filter = allArgs[++i];
+		}
+		else if (allArgs[i] == "-h" || allArgs[i] == "--help")
+		{
+			cout << "Usage: store-traffic-monitor-bench [OPTION]" << endl;
+			cout << "Runs the microbenchmarks of the per-frame steps and prints the time and the heap" << endl;
+			cout << "allocations of one call of each step" << endl;
+			cout << "  -i, --iterations NUMBER  calls per benchmark, " << conf_iterations << " by default" << endl;
+			cout << "  -f, --filter TEXT        only run the benchmarks whose name contains TEXT" << endl;
+			exit(0);
+		}
+		else
+		{
+			cout << "Unknown option " << allArgs[i] << endl;
+			exit(1);
+		}
+	}
+}
+
+// Run fn `iterations` times after a short warm-up and print the time and the
+// allocations per call
+template <typename F>
+void bench(const char *name, int iterations, F fn)
+{
+	if (!conf_filter.empty() && strstr(name, conf_filter.c_str()) == nullptr)
+	{
+		return;
+	}
+	iterations = max(iterations, 1);
+	for (int i = 0; i < iterations / 10 + 1; ++i)
+	{
+		fn();
+	}
+
+	size_t count = allocStatsCount();
+	size_t bytes = allocStatsBytes();
+	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i)
+	{
+		fn();
+	}
+	std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+	count = allocStatsCount() - count;
+	bytes = allocStatsBytes() - bytes;
+
+	double ns = std::chrono::duration_cast<std::chrono::duration<double, std::nano>>(t2 - t1).count();
+	printf("%-28s %14.1f ns/op %10.2f allocs/op %14.1f B/op\n", name, ns / iterations,
+		(double)count / iterations, (double)bytes / iterations);
+}
+
+// SSD output with a few confident boxes among the proposals, like a frame with
+// a handful of people in it. Every other confident box is a person (class 15),
+// so the counting draws some of the boxes
+static vector<float> makeSSDOutput()
+{
+	vector<float> out(conf_maxProposalCount * 7);
+	for (int c = 0; c < conf_maxProposalCount; ++c)
+	{
+		float *box = &out[c * 7];
+		box[0] = 0;
+		box[1] = (c % 32 == 0) ? 15.f : (float)(1 + c % 20);
+		box[2] = (c % 16 == 0) ? 0.9f : 0.05f;
+		box[3] = (c % 10) * 0.09f;
+		box[4] = (c % 7) * 0.12f;
+		box[5] = box[3] + 0.1f;
+		box[6] = box[4] + 0.2f;
+	}
+	return out;
+}
+
+// YOLO output with 20 objects among the boxes, each found by 3 overlapping boxes.
+// The anchor-free output is transposed and has no objectness
+static vector<float> makeYoloOutput(bool anchorFree)
+{
+	const int classStart = anchorFree ? 4 : 5;
+	const int attributes = classStart + conf_yoloClasses;
+	vector<float> out(conf_yoloBoxes * attributes);
+	for (int i = 0; i < conf_yoloBoxes; ++i)
+	{
+		int object = i % 420 < 3 ? i / 420 : -1;
+		float box[4] = {(float)(i % 80) * 8, (float)(i / 80 % 80) * 8, 40, 90};
+		if (object >= 0)
+		{
+			box[0] = 30.0f * object + 2 * (i % 420);
+			box[1] = 300;
+		}
+		for (int a = 0; a < attributes; ++a)
+		{
+			float value = 0.01f;
+			if (a < 4)
+				value = box[a];
+			else if (object >= 0 && (a < classStart || a - classStart == object))
+				value = 0.9f;
+			if (anchorFree)
+				out[a * conf_yoloBoxes + i] = value;
+			else
+				out[i * attributes + a] = value;
+		}
+	}
+	return out;
+}
+
+int main(int argc, char **argv)
+{
+	parseArgs(argc, argv);
+	allocStatsTrackThread();
+
+	Mat frame(conf_frameHeight, conf_frameWidth, CV_8UC3);
+	theRNG().state = 1;
+	randu(frame, Scalar::all(0), Scalar::all(255));
+	Mat frameInfer;
+
+	Mat blob;
+	bench("preprocess/blobFromImage", conf_iterations, [&]() {
+		resize(frame, frameInfer, Size(conf_inferWidth, conf_inferHeight));
+		dnn::blobFromImage(frameInfer, blob, 1.0, Size(), Scalar(), false, false, CV_32F);
+	});
+
+#ifdef HAVE_INFERENCE_ENGINE
+	InferenceEngine::Blob::Ptr inputBlob = InferenceEngine::make_shared_blob<uint8_t>(
+		InferenceEngine::TensorDesc(InferenceEngine::Precision::U8,
+			{1, 3, (size_t)conf_inferHeight, (size_t)conf_inferWidth}, InferenceEngine::Layout::NCHW));
+	inputBlob->allocate();
+	bench("preprocess/matU8ToBlob", conf_iterations, [&]() {
+		resize(frame, frameInfer, Size(conf_inferWidth, conf_inferHeight));
+		matU8ToBlob<uint8_t>(frameInfer, inputBlob);
+	});
+#endif
+
+	vector<float> ssdOutput = makeSSDOutput();
+	vector<Detection> detections;
+	detections.reserve(conf_maxProposalCount);
+	unique_ptr<OutputDecoder> ssd = createDecoder({1, 1, (size_t)conf_maxProposalCount, 7},
+		conf_inferWidth, conf_inferHeight);
+	bench("parse/ssd", conf_iterations * 10, [&]() {
+		ssd->decode(ssdOutput.data(), 0.5f, detections);
+	});
+
+	vector<float> yoloOutput = makeYoloOutput(false);
+	vector<Detection> yoloDetections;
+	yoloDetections.reserve(conf_yoloBoxes);
+	unique_ptr<OutputDecoder> yolo = createDecoder({1, (size_t)conf_yoloBoxes, 5 + (size_t)conf_yoloClasses},
+		conf_yoloSize, conf_yoloSize);
+	bench("parse/yolo", conf_iterations, [&]() {
+		yolo->decode(yoloOutput.data(), 0.5f, yoloDetections);
+	});
+	yoloOutput = makeYoloOutput(true);
+	unique_ptr<OutputDecoder> anchorFree = createDecoder({1, 4 + (size_t)conf_yoloClasses, (size_t)conf_yoloBoxes},
+		conf_yoloSize, conf_yoloSize);
+	bench("parse/yolo-anchor-free", conf_iterations, [&]() {
+		anchorFree->decode(yoloOutput.data(), 0.5f, yoloDetections);
+	});
+
+	// Count the people (label 15 of mobilenet-ssd) on the input frame
+	vector<bool> usedLabels(21, false);
+	usedLabels[14] = true;
+	int count = 0;
+	bench("count/detections", conf_iterations, [&]() {
+		count = countDetections(detections, usedLabels, 14, frame, frame.cols, frame.rows);
+	});
+
+	int candidateCount = 0, candidateConfidence = 0, confirmed = 0, call = 0;
+	bench("count/confirm", conf_iterations * 100, [&]() {
+		// The count changes every 8 frames, so it is confirmed with 6 frames
+		if (confirmCount((call++ / 8) % 4, candidateCount, candidateConfidence, 6))
+		{
+			confirmed++;
+		}
+	});
+
+	Mat display(conf_inferHeight, conf_inferWidth, CV_8UC3, Scalar::all(0));
+	string overlayText;
+	overlayText.reserve(128);
+	string labelName = "person";
+	bench("overlay/putText", conf_iterations, [&]() {
+		drawOverlay(display, overlayText, labelName, 1234, count, 29.97f, 12.5f);
+	});
+
+	vector<pair<int, int>> countAtFrame;
+	vector<frameInfo> uiCountAtFrame;
+	for (int i = 0; i < conf_historySize; ++i)
+	{
+		countAtFrame.emplace_back(i * 15, i % 9);
+		frameInfo fr;
+		fr.frameNo = i * 15;
+		fr.count = i % 9;
+		snprintf(fr.timestamp, sizeof(fr.timestamp), "%02d:%02d:%02d", i / 3600 % 24, i / 60 % 60, i % 60);
+		uiCountAtFrame.push_back(fr);
+	}
+	bench("json/countHistory", conf_iterations / 100, [&]() {
+		ofstream dataJSON(conf_benchFile);
+		dataJSON << "{\n\t\"Video_1\": {\n";
+		writeCountHistory(dataJSON, countAtFrame, 30.0);
+		dataJSON << "\t}\n}";
+	});
+	bench("json/countHistory-ui", conf_iterations / 100, [&]() {
+		ofstream dataJSON(conf_benchFile);
+		dataJSON << "{\n\t\"Video_1\": {\n";
+		writeCountHistory(dataJSON, uiCountAtFrame);
+		dataJSON << "\t}\n}";
+	});
+	remove(conf_benchFile);
+
+	// Keep the results alive, so the compiler cannot drop the benchmarked calls
+	if (count < 0 || confirmed < 0)
+	{
+		cout << count << confirmed << endl;
+	}
+	return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <iostream>
+#include "opencv2/imgcodecs.hpp"
+
+#include <cached_capture.hpp>
+
+static const int conf_cacheJpegQuality = 90;
+
+CachedCapture::CachedCapture(cv::Ptr<cv::VideoCapture> source, const std::string &name, size_t maxBytes,
+	bool jpeg)
+	: source(source)
+	, name(name)
+	, maxBytes(maxBytes)
+	, jpeg(jpeg)
+	, state(Filling)
+	, bytes(0)
+	, position(0)
+	, fromStart(true)
+	, grabbed(false)
+{
+}
+
+void CachedCapture::drop()
+{
+	decoded.release();
+	frames.clear();
+	frames.shrink_to_fit();
+	encoded.clear();
+	encoded.shrink_to_fit();
+	bytes = 0;
+}
+
+bool CachedCapture::isOpened() const
+{
+	return state == Serving || source->isOpened();
+}
+
+void CachedCapture::release()
+{
+	drop();
+	state = Passthrough;
+	source->release();
+}
+
+bool CachedCapture::grab()
+{
+	if (state != Serving)
+	{
+		return source->grab();
+	}
+	grabbed = position < (long)(jpeg ? encoded.size() : frames.size());
+	return grabbed;
+}
+
+bool CachedCapture::retrieve(cv::OutputArray image, int flag)
+{
+	if (state != Serving)
+	{
+		if (!source->retrieve(image, flag))
+		{
+			return false;
+		}
+		if (state == Filling && fromStart)
+		{
+			cv::Mat frame = image.getMat();
+			size_t size;
+			if (jpeg)
+			{
+				encoded.emplace_back();
+				cv::imencode(".jpg", frame, encoded.back(), {cv::IMWRITE_JPEG_QUALITY, conf_cacheJpegQuality});
+				size = encoded.back().size();
+			}
+			else
+			{
+				frames.push_back(frame.clone());
+				size = frame.total() * frame.elemSize();
+			}
+			bytes += size;
+			if (bytes > maxBytes)
+			{
+				std::cout << name << " does not fit in the frame cache, it is decoded on every loop" << std::endl;
+				drop();
+				state = Passthrough;
+			}
+		}
+		position++;
+		return true;
+	}
+
+	if (!grabbed)
+	{
+		image.release();
+		return false;
+	}
+	grabbed = false;
+	// The cached frame is copied, because the caller draws on the frames it reads
+	if (jpeg)
+	{
+		cv::imdecode(encoded[position], cv::IMREAD_COLOR, &decoded);
+		decoded.copyTo(image);
+	}
+	else
+	{
+		frames[position].copyTo(image);
+	}
+	position++;
+	return true;
+}
+
+bool CachedCapture::read(cv::OutputArray image)
+{
+	if (!grab())
+	{
+		image.release();
+		return false;
+	}
+	return retrieve(image);
+}
+
+bool CachedCapture::set(int propId, double value)
+{
+	if (propId != cv::CAP_PROP_POS_FRAMES)
+	{
+		return state == Serving ? false : source->set(propId, value);
+	}
+
+	long frameNo = (long)value;
+	if (state == Filling && frameNo == 0 && fromStart && (frames.size() || encoded.size()))
+	{
+		// First rewind: the clip is complete, decoding is not needed any more
+		state = Serving;
+		std::cout << name << " is looped from the frame cache (" << bytes / (1024 * 1024) << " MB)" << std::endl;
+	}
+	if (state == Serving)
+	{
+		if (frameNo < 0 || frameNo >= (long)(jpeg ? encoded.size() : frames.size()))
+		{
+			return false;
+		}
+		position = frameNo;
+		return true;
+	}
+
+	if (state == Filling && frameNo != position)
+	{
+		// The cached frames must be consecutive from the start of the clip
+		drop();
+		fromStart = frameNo == 0;
+	}
+	position = frameNo;
+	return source->set(propId, value);
+}
+
+double CachedCapture::get(int propId) const
+{
+	if (state != Serving)
+	{
+		return source->get(propId);
+	}
+	switch (propId)
+	{
+	case cv::CAP_PROP_FRAME_COUNT:
+		return (double)(jpeg ? encoded.size() : frames.size());
+	case cv::CAP_PROP_POS_FRAMES:
+		return (double)position;
+	case cv::CAP_PROP_POS_MSEC:
+	{
+		double fps = source->get(cv::CAP_PROP_FPS);
+		return fps > 0 ? position * 1000 / fps : 0;
+	}
+	default:
+		return source->get(propId);
+	}
+}
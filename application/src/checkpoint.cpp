@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <checkpoint.hpp>
+#include <trace.hpp>
+
+static const uint32_t snapshotMagic = 0x50434d53; // "SMCP"
+static const uint32_t snapshotVersion = 1;
+
+struct SnapshotHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t streams;
+	uint32_t crc;           // Of journalSize and the StreamCounters that follow
+	uint64_t journalSize;
+};
+
+static uint32_t crc32(uint32_t crc, const void *data, size_t size)
+{
+	const uint8_t *p = static_cast<const uint8_t *>(data);
+	crc = ~crc;
+	while (size--)
+	{
+		crc ^= *p++;
+		for (int k = 0; k < 8; ++k)
+		{
+			crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+		}
+	}
+	return ~crc;
+}
+
+static uint32_t snapshotCrc(uint64_t journalSize, const std::vector<StreamCounters> &counters)
+{
+	uint32_t crc = crc32(0, &journalSize, sizeof(journalSize));
+	return crc32(crc, counters.data(), counters.size() * sizeof(StreamCounters));
+}
+
+static bool writeAll(int fd, const void *data, size_t size)
+{
+	const char *p = static_cast<const char *>(data);
+	while (size > 0)
+	{
+		ssize_t n = ::write(fd, p, size);
+		if (n <= 0)
+		{
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+static bool readAll(int fd, void *data, size_t size)
+{
+	char *p = static_cast<char *>(data);
+	while (size > 0)
+	{
+		ssize_t n = ::read(fd, p, size);
+		if (n <= 0)
+		{
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+Checkpointer::Checkpointer(const std::string &dir, size_t streams, int intervalMs)
+	: snapshotPath(dir + "/counts.snapshot")
+	, journalPath(dir + "/counts.journal")
+	, dir(dir)
+	, streams(streams)
+	, intervalMs(intervalMs)
+	, stopping(false)
+	, dirty(false)
+	, flushRequests(0)
+	, flushesDone(0)
+	, lastWritten(true)
+	, journalFd(-1)
+	, journalSize(0)
+{
+	mkdir(dir.c_str(), 0755);
+}
+
+Checkpointer::~Checkpointer()
+{
+	if (writer.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		wake.notify_one();
+		writer.join();
+	}
+	if (journalFd >= 0)
+	{
+		close(journalFd);
+	}
+}
+
+bool Checkpointer::restore(std::vector<StreamCounters> &counters, std::vector<std::vector<CountRecord>> &history)
+{
+	int fd = open(snapshotPath.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+	SnapshotHeader header;
+	std::vector<StreamCounters> saved(streams);
+	bool ok = readAll(fd, &header, sizeof(header)) && header.magic == snapshotMagic &&
+		header.version == snapshotVersion && header.streams == streams &&
+		readAll(fd, saved.data(), streams * sizeof(StreamCounters)) &&
+		header.crc == snapshotCrc(header.journalSize, saved);
+	close(fd);
+	if (!ok)
+	{
+		std::cout << "Ignoring checkpoint " << snapshotPath << ": it is damaged or for other videos" << std::endl;
+		return false;
+	}
+	for (size_t i = 0; i < streams; ++i)
+	{
+		if (strncmp(saved[i].label, counters[i].label, checkpointLabelLength) != 0)
+		{
+			std::cout << "Ignoring checkpoint " << snapshotPath << ": the labels of the videos changed" << std::endl;
+			return false;
+		}
+	}
+
+	// Replay the journal up to the size recorded in the snapshot
+	history.assign(streams, std::vector<CountRecord>());
+	fd = open(journalPath.c_str(), O_RDONLY);
+	uint64_t numRecords = header.journalSize / sizeof(JournalRecord);
+	for (uint64_t i = 0; i < numRecords; ++i)
+	{
+		JournalRecord r;
+		if (fd < 0 || !readAll(fd, &r, sizeof(r)) || r.stream >= streams)
+		{
+			std::cout << "Ignoring checkpoint " << snapshotPath << ": the journal is incomplete" << std::endl;
+			if (fd >= 0)
+			{
+				close(fd);
+			}
+			return false;
+		}
+		history[r.stream].push_back(r.record);
+	}
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+	for (size_t i = 0; i < streams; ++i)
+	{
+		if (history[i].size() != saved[i].historySize)
+		{
+			std::cout << "Ignoring checkpoint " << snapshotPath << ": the journal does not match" << std::endl;
+			return false;
+		}
+	}
+
+	counters = saved;
+	journalSize = header.journalSize;
+	return true;
+}
+
+void Checkpointer::start(const std::vector<StreamCounters> &counters)
+{
+	// Drop the journal records that were written after the last snapshot
+	journalFd = open(journalPath.c_str(), O_WRONLY | O_CREAT, 0644);
+	if (journalFd < 0 || ftruncate(journalFd, journalSize) != 0 || lseek(journalFd, journalSize, SEEK_SET) < 0)
+	{
+		std::cout << "Could not open " << journalPath << ", checkpoints are disabled" << std::endl;
+		return;
+	}
+	pendingCounters = counters;
+	pendingRecords.reserve(1024);
+	dirty = true;
+	writer = std::thread(&Checkpointer::run, this);
+}
+
+void Checkpointer::update(size_t stream, const StreamCounters &counters, const CountRecord *newRecords, size_t numRecords)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (!writer.joinable())
+	{
+		return;
+	}
+	pendingCounters[stream] = counters;
+	for (size_t i = 0; i < numRecords; ++i)
+	{
+		JournalRecord r;
+		r.stream = stream;
+		r.record = newRecords[i];
+		pendingRecords.push_back(r);
+	}
+	dirty = true;
+}
+
+void Checkpointer::run()
+{
+	std::vector<StreamCounters> counters;
+	std::vector<JournalRecord> records;
+	records.reserve(1024);
+	traceThreadName("checkpoint");
+	std::unique_lock<std::mutex> guard(lock);
+	for (;;)
+	{
+		wake.wait_for(guard, std::chrono::milliseconds(intervalMs), [this]() {
+			return stopping || flushRequests != flushesDone;
+		});
+		bool stop = stopping;
+		uint64_t requests = flushRequests;
+		bool written = true;
+		if (dirty)
+		{
+			counters = pendingCounters;
+			records.swap(pendingRecords);
+			dirty = false;
+			guard.unlock();
+			bool journaled;
+			{
+				TRACE_SCOPE("checkpoint write");
+				journaled = writeJournal(records);
+				written = journaled && writeSnapshot(counters);
+			}
+			if (!written)
+			{
+				std::cout << "Could not write checkpoint " << snapshotPath << std::endl;
+			}
+			guard.lock();
+			if (!journaled)
+			{
+				// The records go back in front of the newer ones, for the next attempt
+				records.insert(records.end(), pendingRecords.begin(), pendingRecords.end());
+				records.swap(pendingRecords);
+			}
+			records.clear();
+			dirty = dirty || !written;
+		}
+		lastWritten = written;
+		flushesDone = requests;
+		flushed.notify_all();
+		if (stop)
+		{
+			return;
+		}
+	}
+}
+
+bool Checkpointer::flush()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	if (!writer.joinable())
+	{
+		return false;
+	}
+	uint64_t request = ++flushRequests;
+	wake.notify_one();
+	flushed.wait(guard, [this, request]() { return flushesDone >= request; });
+	return lastWritten;
+}
+
+bool Checkpointer::writeJournal(const std::vector<JournalRecord> &records)
+{
+	if (records.empty())
+	{
+		return true;
+	}
+	if (!writeAll(journalFd, records.data(), records.size() * sizeof(JournalRecord)) || fdatasync(journalFd) != 0)
+	{
+		// Keep the journal aligned on whole records for the next attempt
+		if (ftruncate(journalFd, journalSize) != 0 || lseek(journalFd, journalSize, SEEK_SET) < 0)
+		{
+			std::cout << "Could not restore " << journalPath << std::endl;
+		}
+		return false;
+	}
+	journalSize += records.size() * sizeof(JournalRecord);
+	return true;
+}
+
+bool Checkpointer::writeSnapshot(const std::vector<StreamCounters> &counters)
+{
+	SnapshotHeader header;
+	header.magic = snapshotMagic;
+	header.version = snapshotVersion;
+	header.streams = streams;
+	header.journalSize = journalSize;
+	header.crc = snapshotCrc(journalSize, counters);
+
+	std::string tmpPath = snapshotPath + ".tmp";
+	int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		return false;
+	}
+	bool ok = writeAll(fd, &header, sizeof(header)) &&
+		writeAll(fd, counters.data(), counters.size() * sizeof(StreamCounters)) &&
+		fdatasync(fd) == 0;
+	close(fd);
+	if (!ok || rename(tmpPath.c_str(), snapshotPath.c_str()) != 0)
+	{
+		return false;
+	}
+
+	// Make the rename itself durable
+	int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+	if (dirFd >= 0)
+	{
+		fsync(dirFd);
+		close(dirFd);
+	}
+	return true;
+}
@@ -0,0 +1,470 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+// Inference daemon. It loads the model once and serves the inferences of every
+// store-traffic-monitor process of the host that uses the "remote" backend, so
+// the processes do not each compile their own copy of the model and run their
+// own inference threads. The protocol is described in daemon_protocol.hpp.
+//
+//   store-traffic-monitor-daemon -m MODEL [OPTIONS]
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "opencv2/core.hpp"
+
+#include <daemon_protocol.hpp>
+#include <inference_backend.hpp>
+
+using namespace std;
+
+static BackendConfig conf_backend;
+static string conf_socket = daemonDefaultSocket;
+
+// A connected monitor process and the shared memory of its frames
+struct Client {
+	int fd = -1;
+	int id = 0;
+	uint8_t *mem = nullptr;
+	size_t memSize = 0;
+	uint32_t requests = 0;
+	float threshold = 0;
+	mutex sendMutex;    // The results of several backend requests are sent concurrently
+
+	~Client()
+	{
+		if (mem)
+		{
+			munmap(mem, memSize);
+		}
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+	}
+};
+
+// A frame waiting for a free request of the backend
+struct Job {
+	shared_ptr<Client> client;
+	uint32_t request;
+};
+
+// Request pool scheduler. The frames of all the clients go to one queue, in
+// arrival order, and every request of the backend has a worker thread that takes
+// the next frame as soon as its previous inference is done. The backend thus has
+// as many inferences in flight as it has requests, whichever process they come from.
+class Scheduler {
+public:
+	Scheduler(InferenceBackend &backend)
+		: backend(backend)
+	{
+		for (size_t r = 0; r < backend.requestCount(); ++r)
+		{
+			thread(&Scheduler::work, this, r).detach();
+		}
+	}
+
+	void push(Job job)
+	{
+		{
+			lock_guard<mutex> lock(jobsMutex);
+			jobs.push_back(std::move(job));
+		}
+		jobsReady.notify_one();
+	}
+
+private:
+	void work(size_t request)
+	{
+		vector<Detection> detections;
+		vector<DaemonDetection> out;
+		for (;;)
+		{
+			Job job;
+			{
+				unique_lock<mutex> lock(jobsMutex);
+				jobsReady.wait(lock, [this]() { return !jobs.empty(); });
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+			Client &client = *job.client;
+
+			// The frame is inferred in place in the shared memory of the client
+			DaemonResult result = {job.request, 0, 0};
+			cv::Mat frame(backend.inputHeight(), backend.inputWidth(), CV_8UC3,
+				client.mem + job.request * (client.memSize / client.requests));
+			try
+			{
+				backend.submit(request, frame);
+				if (!backend.wait(request, detections))
+				{
+					// No stale detections of the previous job are sent back
+					detections.clear();
+					result.status = -1;
+				}
+			}
+			catch (const std::exception &e)
+			{
+				cout << "Inference failed for client " << client.id << ": " << e.what() << endl;
+				detections.clear();
+				result.status = -1;
+			}
+
+			out.clear();
+			for (const Detection &d : detections)
+			{
+				if (d.confidence > client.threshold)
+				{
+					DaemonDetection dd = {d.label, d.confidence, d.xmin, d.ymin, d.xmax, d.ymax};
+					out.push_back(dd);
+				}
+			}
+			result.numDetections = out.size();
+			// A client that went away only makes the sends fail
+			lock_guard<mutex> lock(client.sendMutex);
+			if (daemonSend(client.fd, &result, sizeof(result)))
+			{
+				daemonSend(client.fd, out.data(), out.size() * sizeof(DaemonDetection));
+			}
+		}
+	}
+
+	InferenceBackend &backend;
+	mutex jobsMutex;
+	condition_variable jobsReady;
+	deque<Job> jobs;
+};
+
+// Create the shared memory of a client and send its descriptor with the welcome.
+// The object is unlinked at once, so it only lives as long as it is mapped
+static bool welcomeClient(Client &client, InferenceBackend &backend)
+{
+	DaemonWelcome welcome;
+	memset(&welcome, 0, sizeof(welcome));
+	welcome.magic = daemonMagic;
+	welcome.version = daemonVersion;
+	welcome.requests = client.requests;
+	welcome.inputWidth = backend.inputWidth();
+	welcome.inputHeight = backend.inputHeight();
+	welcome.slotSize = (backend.inputWidth() * backend.inputHeight() * 3 + 63) / 64 * 64;
+	strncpy(welcome.backend, backend.name(), sizeof(welcome.backend) - 1);
+
+	string name = "/stm_daemon_" + to_string(getpid()) + "_" + to_string(client.id);
+	int memFd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (memFd < 0)
+	{
+		cout << "Could not create shared memory " << name << endl;
+		return false;
+	}
+	shm_unlink(name.c_str());
+	client.memSize = welcome.slotSize * client.requests;
+	void *mem = MAP_FAILED;
+	if (ftruncate(memFd, client.memSize) == 0)
+	{
+		mem = mmap(nullptr, client.memSize, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+	}
+	if (mem == MAP_FAILED)
+	{
+		cout << "Could not allocate shared memory for client " << client.id << endl;
+		close(memFd);
+		return false;
+	}
+	client.mem = static_cast<uint8_t *>(mem);
+
+	char control[CMSG_SPACE(sizeof(int))];
+	memset(control, 0, sizeof(control));
+	struct iovec iov = {&welcome, sizeof(welcome)};
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &memFd, sizeof(int));
+	ssize_t n = sendmsg(client.fd, &msg, MSG_NOSIGNAL);
+	close(memFd);
+	return n > 0 && daemonSend(client.fd, reinterpret_cast<char *>(&welcome) + n, sizeof(welcome) - n);
+}
+
+// Read the frames submitted by a client until it disconnects
+static void serveClient(shared_ptr<Client> client, InferenceBackend &backend, Scheduler &scheduler)
+{
+	DaemonHello hello;
+	if (!daemonReceive(client->fd, &hello, sizeof(hello)))
+	{
+		return;
+	}
+	if (hello.magic != daemonMagic || hello.version != daemonVersion || hello.requests == 0)
+	{
+		cout << "Client " << client->id << " does not speak the protocol version " << daemonVersion << endl;
+		DaemonWelcome refused;
+		memset(&refused, 0, sizeof(refused));
+		refused.magic = daemonMagic;
+		refused.version = daemonVersion;
+		refused.status = -1;
+		daemonSend(client->fd, &refused, sizeof(refused));
+		return;
+	}
+	client->requests = min(hello.requests, daemonMaxRequests);
+	client->threshold = hello.threshold;
+	if (!welcomeClient(*client, backend))
+	{
+		return;
+	}
+	cout << "Client " << client->id << " connected with " << client->requests << " requests" << endl;
+
+	DaemonSubmit submit;
+	long frames = 0;
+	while (daemonReceive(client->fd, &submit, sizeof(submit)))
+	{
+		if (submit.request >= client->requests)
+		{
+			cout << "Client " << client->id << " submitted on unknown request " << submit.request << endl;
+			break;
+		}
+		scheduler.push(Job{client, submit.request});
+		++frames;
+	}
+	// Unblock the client if it is still waiting; the jobs in the queue keep
+	// the memory mapped until they are done
+	shutdown(client->fd, SHUT_RDWR);
+	cout << "Client " << client->id << " disconnected after " << frames << " frames" << endl;
+}
+
+static void removeSocket(int)
+{
+	unlink(conf_socket.c_str());
+	_exit(0);
+}
+
+void parseArgs(int argc, char **argv)
+{
+	std::vector<string> allArgs(argv, argv + argc);
+
+	conf_backend.device = "CPU";
+	// Every client filters the detections again with its own threshold. Below this
+	// one, YOLO outputs would send thousands of boxes through the overlap removal
+	conf_backend.threshold = 0.1f;
+	conf_backend.requests = max(1u, thread::hardware_concurrency());
+#ifdef HAVE_INFERENCE_ENGINE
+	conf_backend.type = "ie";
+#else
+	conf_backend.type = "dnn";
+#endif
+	for (size_t i = 1; i < allArgs.size(); ++i)
+	{
+		if (i + 1 < allArgs.size() && (allArgs[i] == "-m" || allArgs[i] == "--model"))
+		{
+			conf_backend.model = allArgs[++i];
+		}
+		else if (i + 1 < allArgs.size() && (allArgs[i] == "-w" || allArgs[i] == "--weights"))
+		{
+			conf_backend.weights = allArgs[++i];
+		}
+		else if (i + 1 < allArgs.size() && (allArgs[i] == "-d" || allArgs[i] == "--device"))
+		{
+			conf_backend.device = allArgs[++i];
+		}
+		else if (i + 1 < allArgs.size() && (allArgs[i] == "-b" || allArgs[i] == "--backend"))
+		{
+			conf_backend.type = allArgs[++i];
+		}
+		else if (i + 1 < allArgs.size() && (allArgs[i] == "-sz" || allArgs[i] == "--size"))
+		{
+			if (sscanf(allArgs[++i].c_str(), "%zux%zu", &conf_backend.inputWidth, &conf_backend.inputHeight) != 2)
+			{
+				cout << "Invalid input size " << allArgs[i] << ", expected WIDTHxHEIGHT" << endl;
+				exit(1);
+			}
+		}
+		else if (i + 1 < allArgs.size() && (allArgs[i] == "-ps" || allArgs[i] == "--pixel-scale"))
+		{
+			conf_backend.pixelScale = atof(allArgs[++i].c_str());
+		}
+		else if (i + 1 < allArgs.size() && (allArgs[i] == "-mv" || allArgs[i] == "--mean-values"))
+		{
+			stringstream list(allArgs[++i]);
+			string item;
+			while (getline(list, item, ','))
+			{
+				conf_backend.mean.push_back(atof(item.c_str()));
+			}
+			if (conf_backend.mean.size() != 1 && conf_backend.mean.size() != 3)
+			{
+				cout << "Invalid mean values " << allArgs[i] << ", expected one or three values" << endl;
+				exit(1);
+			}
+		}
+		else if (i + 1 < allArgs.size() && (allArgs[i] == "-rb" || allArgs[i] == "--swap-rb"))
+		{
+			conf_backend.swapRB = allArgs[++i] == "true";
+		}
+		else if (i + 1 < allArgs.size() && (allArgs[i] == "-ss" || allArgs[i] == "--synthetic-script"))
+		{
+			conf_backend.script = allArgs[++i];
+		}
+		else if (i + 1 < allArgs.size() && (allArgs[i] == "-sl" || allArgs[i] == "--synthetic-latency"))
+		{
+			conf_backend.latencyMs = atoi(allArgs[++i].c_str());
+		}
+		else if (i + 1 < allArgs.size() && (allArgs[i] == "-nr" || allArgs[i] == "--requests"))
+		{
+			conf_backend.requests = max(1, atoi(allArgs[++i].c_str()));
+		}
+		else if (i + 1 < allArgs.size() && (allArgs[i] == "-th" || allArgs[i] == "--threshold"))
+		{
+			conf_backend.threshold = atof(allArgs[++i].c_str());
+		}
+		else if (i + 1 < allArgs.size() && (allArgs[i] == "-sk" || allArgs[i] == "--socket"))
+		{
+			conf_socket = allArgs[++i];
+		}
+		else if (allArgs[i] == "-h" || allArgs[i] == "--help")
+		{
+			cout << "Usage: store-traffic-monitor-daemon -m MODEL [OPTION]" << endl;
+			cout << "Loads the model once and runs the inferences of the store-traffic-monitor" << endl;
+			cout << "processes started with -b remote" << endl;
+			cout << "  -m, --model PATH            .xml file containing the model layers" << endl;
+			cout << "  -w, --weights PATH          model weights, the .bin file next to the .xml file by default" << endl;
+			cout << "  -d, --device DEVICE         CPU, GPU, MYRIAD, HETERO:FPGA,CPU or HDDL, CPU by default" << endl;
+			cout << "  -b, --backend BACKEND       ie, dnn or synthetic" << endl;
+			cout << "  -sz, --size WIDTHxHEIGHT    network input size for the dnn and synthetic backends" << endl;
+			cout << "  -ps, --pixel-scale VALUE    factor of the pixels once the mean is subtracted, for the dnn backend" << endl;
+			cout << "  -mv, --mean-values R,G,B    mean of the pixels, for the dnn backend" << endl;
+			cout << "  -rb, --swap-rb true         feed the dnn backend RGB frames instead of BGR" << endl;
+			cout << "  -ss, --synthetic-script PATH  detections returned by the synthetic backend" << endl;
+			cout << "  -sl, --synthetic-latency MS   latency of the synthetic backend" << endl;
+			cout << "  -nr, --requests NUMBER      inferences in flight, one per CPU core by default" << endl;
+			cout << "  -th, --threshold VALUE      lowest confidence the clients can use, " << conf_backend.threshold << " by default" << endl;
+			cout << "  -sk, --socket PATH          Unix socket of the daemon, " << daemonDefaultSocket << " by default" << endl;
+			exit(0);
+		}
+		else
+		{
+			cout << "Unknown option " << allArgs[i] << endl;
+			exit(1);
+		}
+	}
+
+	size_t pos = conf_backend.model.rfind(".");
+	if (conf_backend.weights.empty() && pos != string::npos && conf_backend.model.substr(pos) == ".xml")
+	{
+		conf_backend.weights = conf_backend.model.substr(0, pos) + ".bin";
+	}
+	if (conf_backend.model.empty() && conf_backend.type != "synthetic")
+	{
+		cout << "You need to specify the path to the .xml file with -m MODEL" << endl;
+		exit(1);
+	}
+	// One stream per request in flight, the requests come from many clients
+	conf_backend.streams = conf_backend.requests;
+	if (conf_backend.type == "remote")
+	{
+		cout << "The daemon cannot use the remote backend" << endl;
+		exit(1);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	parseArgs(argc, argv);
+
+	unique_ptr<InferenceBackend> backend;
+	try
+	{
+		backend = createBackend(conf_backend);
+	}
+	catch (const std::exception &e)
+	{
+		cout << e.what() << endl;
+		return 2;
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, conf_socket.c_str(), sizeof(addr.sun_path) - 1);
+	// A socket file left by a daemon that was killed is replaced, but not the
+	// socket of a daemon that is still running
+	int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (probe >= 0 && connect(probe, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == 0)
+	{
+		close(probe);
+		cout << "Another daemon is already listening on " << conf_socket << endl;
+		return 3;
+	}
+	if (probe >= 0 && errno == ECONNREFUSED)
+	{
+		unlink(conf_socket.c_str());
+	}
+	if (probe >= 0)
+	{
+		close(probe);
+	}
+	if (fd < 0 || bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0 || listen(fd, 16) != 0)
+	{
+		cout << "Could not listen on " << conf_socket << endl;
+		return 3;
+	}
+	// The workers of the scheduler never stop, so the daemon can no longer return
+	Scheduler scheduler(*backend);
+	signal(SIGINT, removeSocket);
+	signal(SIGTERM, removeSocket);
+	cout << "Serving " << conf_backend.model << " on the " << backend->name() << " backend with "
+		<< backend->requestCount() << " requests at " << conf_socket << endl;
+
+	int clients = 0;
+	for (;;)
+	{
+		int clientFd = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+		if (clientFd < 0)
+		{
+			continue;
+		}
+		shared_ptr<Client> client = make_shared<Client>();
+		client->fd = clientFd;
+		client->id = ++clients;
+		thread(serveClient, client, std::ref(*backend), std::ref(scheduler)).detach();
+	}
+}
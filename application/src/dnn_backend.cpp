@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "opencv2/dnn.hpp"
+
+#include <inference_backend.hpp>
+#include <output_decoder.hpp>
+
+// OpenCV DNN backend, on the target of the device. cv::dnn::Net is not thread safe, so every
+// request owns a copy of the network and a worker thread that runs it. The
+// threads live as long as the backend, so an inference neither starts a thread
+// nor allocates once the buffers have their size.
+class DnnBackend : public InferenceBackend {
+public:
+	DnnBackend(const BackendConfig &config)
+		: threshold(config.threshold)
+		, width(scaledInputSize(config.inputWidth, config.scale))
+		, height(scaledInputSize(config.inputHeight, config.scale))
+		, swapRB(config.swapRB)
+		, errorLogged(false)
+		, slots(config.requests)
+	{
+		setPreprocessing(config);
+		int dnnBackend = cv::dnn::DNN_BACKEND_DEFAULT;
+		int target = cv::dnn::DNN_TARGET_CPU;
+		getTarget(config.device, dnnBackend, target);
+		for (auto &slot : slots)
+		{
+			slot.net = cv::dnn::readNet(config.model, config.weights);
+			if (slot.net.empty())
+			{
+				throw std::logic_error("Could not load " + config.model + " with OpenCV DNN");
+			}
+			slot.net.setPreferableBackend(dnnBackend);
+			slot.net.setPreferableTarget(target);
+		}
+		for (auto &slot : slots)
+		{
+			slot.worker = std::thread(&DnnBackend::work, this, std::ref(slot));
+		}
+	}
+
+	~DnnBackend()
+	{
+		for (auto &slot : slots)
+		{
+			{
+				std::lock_guard<std::mutex> guard(slot.lock);
+				slot.stopping = true;
+			}
+			slot.wake.notify_one();
+			slot.worker.join();
+		}
+	}
+
+	const char *name() const
+	{
+		return "dnn";
+	}
+
+	size_t inputWidth() const
+	{
+		return width;
+	}
+
+	size_t inputHeight() const
+	{
+		return height;
+	}
+
+	size_t requestCount() const
+	{
+		return slots.size();
+	}
+
+	void submit(size_t request, const cv::Mat &frame)
+	{
+		Slot &slot = slots[request];
+		cv::dnn::blobFromImage(frame, slot.input, pixelScale, cv::Size(), mean, swapRB, false, CV_32F);
+		slot.net.setInput(slot.input);
+		{
+			std::lock_guard<std::mutex> guard(slot.lock);
+			slot.running = true;
+			slot.submitted = true;
+		}
+		slot.wake.notify_one();
+	}
+
+	bool wait(size_t request, std::vector<Detection> &detections)
+	{
+		Slot &slot = slots[request];
+		{
+			std::unique_lock<std::mutex> guard(slot.lock);
+			if (!slot.submitted)
+			{
+				return false;
+			}
+			slot.wake.wait(guard, [&slot]() { return !slot.running; });
+			slot.submitted = false;
+		}
+		if (!slot.error.empty())
+		{
+			// Failed like the other backends do; a network that fails keeps failing,
+			// so the error is only shown once
+			if (!errorLogged.exchange(true))
+			{
+				std::cout << "Inference failed on the dnn backend: " << slot.error << std::endl;
+			}
+			slot.error.clear();
+			return false;
+		}
+		// The output shape is only known once the network has run
+		if (!slot.decoder)
+		{
+			std::vector<size_t> dims(slot.output.size.p, slot.output.size.p + slot.output.dims);
+			slot.decoder = createDecoder(dims, width, height);
+		}
+		slot.decoder->decode(slot.output.ptr<float>(), threshold, detections);
+		return true;
+	}
+
+private:
+	struct Slot {
+		cv::dnn::Net net;
+		cv::Mat input;
+		cv::Mat output;
+		std::unique_ptr<OutputDecoder> decoder;
+
+		std::thread worker;
+		std::mutex lock;
+		std::condition_variable wake;   // Both ways: a frame to infer, an inference done
+		bool submitted = false;         // Until the result is collected by wait()
+		bool running = false;           // While the worker infers the frame
+		bool stopping = false;
+		std::string error;              // Of the last inference, empty if it succeeded
+	};
+
+	// An IR carries the mean and scale given to the model optimizer, other models
+	// get those of the Caffe mobilenet-ssd unless the config tells otherwise
+	void setPreprocessing(const BackendConfig &config)
+	{
+		size_t pos = config.model.rfind(".");
+		bool isIR = pos != std::string::npos && config.model.substr(pos) == ".xml";
+		pixelScale = config.pixelScale > 0 ? config.pixelScale : isIR ? 1.0 : 0.007843;
+		if (config.mean.empty())
+		{
+			mean = isIR ? cv::Scalar() : cv::Scalar(127.5, 127.5, 127.5);
+		}
+		else if (config.mean.size() == 1)
+		{
+			mean = cv::Scalar(config.mean[0], config.mean[0], config.mean[0]);
+		}
+		else if (config.mean.size() == 3)
+		{
+			mean = cv::Scalar(config.mean[0], config.mean[1], config.mean[2]);
+		}
+		else
+		{
+			throw std::logic_error("The mean must have one or three values");
+		}
+	}
+
+	// The default DNN backend is the Inference Engine when OpenCV is built with it,
+	// the OpenCV implementation otherwise. The VPU and FPGA targets need the Inference Engine
+	static void getTarget(const std::string &device, int &dnnBackend, int &target)
+	{
+		if (device.empty() || device == "CPU")
+		{
+			dnnBackend = cv::dnn::DNN_BACKEND_DEFAULT;
+			target = cv::dnn::DNN_TARGET_CPU;
+		}
+		else if (device == "GPU")
+		{
+			dnnBackend = cv::dnn::DNN_BACKEND_DEFAULT;
+			target = cv::dnn::DNN_TARGET_OPENCL;
+		}
+		else if (device == "MYRIAD")
+		{
+			dnnBackend = cv::dnn::DNN_BACKEND_INFERENCE_ENGINE;
+			target = cv::dnn::DNN_TARGET_MYRIAD;
+		}
+		else if (device == "HETERO:FPGA,CPU")
+		{
+			dnnBackend = cv::dnn::DNN_BACKEND_INFERENCE_ENGINE;
+			target = cv::dnn::DNN_TARGET_FPGA;
+		}
+		else
+		{
+			throw std::logic_error("Device " + device + " is not supported by the OpenCV DNN backend");
+		}
+	}
+
+	void work(Slot &slot)
+	{
+		std::unique_lock<std::mutex> guard(slot.lock);
+		for (;;)
+		{
+			slot.wake.wait(guard, [&slot]() { return slot.running || slot.stopping; });
+			if (slot.stopping)
+			{
+				return;
+			}
+			guard.unlock();
+			try
+			{
+				slot.net.forward(slot.output);
+			}
+			catch (const std::exception &e)
+			{
+				slot.error = e.what();
+			}
+			catch (...)
+			{
+				slot.error = "unknown error";
+			}
+			guard.lock();
+			slot.running = false;
+			slot.wake.notify_all();
+		}
+	}
+
+	float threshold;
+	size_t width;
+	size_t height;
+	double pixelScale;
+	cv::Scalar mean;
+	bool swapRB;
+	std::atomic<bool> errorLogged;
+	std::vector<Slot> slots;
+};
+
+std::unique_ptr<InferenceBackend> createDnnBackend(const BackendConfig &config)
+{
+	return std::unique_ptr<InferenceBackend>(new DnnBackend(config));
+}
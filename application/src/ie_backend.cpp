@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <map>
+#include <stdexcept>
+#include <inference_engine.hpp>
+#include <samples/ocv_common.hpp>
+#include <samples/slog.hpp>
+
+#include <inference_backend.hpp>
+#include <output_decoder.hpp>
+
+using namespace InferenceEngine;
+
+// Inference Engine backend. Every request of the backend is an InferRequest of
+// the same ExecutableNetwork.
+class IEBackend : public InferenceBackend {
+public:
+	IEBackend(const BackendConfig &config)
+		: threshold(config.threshold)
+	{
+		Core ie;
+		auto network = ie.ReadNetwork(config.model, config.weights);
+		network.setBatchSize(1);
+
+		InputsDataMap inputInfo(network.getInputsInfo());
+		std::string imageInfoInputName;
+		for (const auto &inputInfoItem : inputInfo)
+		{
+			if (inputInfoItem.second->getInputData()->getTensorDesc().getDims().size() == 4)
+			{ // first input contains images
+				imageInputName = inputInfoItem.first;
+				inputInfoItem.second->setPrecision(Precision::U8);
+				inputInfoItem.second->getInputData()->setLayout(Layout::NCHW);
+				const TensorDesc &inputDesc = inputInfoItem.second->getTensorDesc();
+				netInputHeight = getTensorHeight(inputDesc);
+				netInputWidth = getTensorWidth(inputDesc);
+				netInputChannel = getTensorChannels(inputDesc);
+			}
+			else if (inputInfoItem.second->getTensorDesc().getDims().size() == 2)
+			{ // second input contains image info
+				imageInfoInputName = inputInfoItem.first;
+				inputInfoItem.second->setPrecision(Precision::FP32);
+			}
+			else
+			{
+				throw std::logic_error(
+					"Unsupported " +
+					std::to_string(
+					inputInfoItem.second->getTensorDesc().getDims().size()) +
+					"D "
+					"input layer '" +
+					inputInfoItem.first + "'. "
+					"Only 2D and 4D input layers are supported");
+			}
+		}
+
+		if (config.scale != 1)
+		{
+			// The model must support reshaping, like the SSD and YOLO IRs do
+			ICNNNetwork::InputShapes shapes = network.getInputShapes();
+			SizeVector &dims = shapes[imageInputName];
+			netInputHeight = dims[2] = scaledInputSize(netInputHeight, config.scale);
+			netInputWidth = dims[3] = scaledInputSize(netInputWidth, config.scale);
+			network.reshape(shapes);
+			slog::info << "Reshaped to " << netInputWidth << "x" << netInputHeight << slog::endl;
+		}
+
+		OutputsDataMap outputInfo(network.getOutputsInfo());
+		if (outputInfo.size() != 1) {
+			throw std::logic_error("This demo accepts networks having only one output");
+		}
+		DataPtr &output = outputInfo.begin()->second;
+		outputName = outputInfo.begin()->first;
+		const SizeVector outputDims = output->getTensorDesc().getDims();
+		// Throws if the output is neither SSD nor YOLO
+		slots.resize(config.requests);
+		for (Slot &slot : slots)
+		{
+			slot.decoder = createDecoder(outputDims, netInputWidth, netInputHeight);
+		}
+		output->setPrecision(Precision::FP32);
+		output->setLayout(outputDims.size() == 4 ? Layout::NCHW : Layout::CHW);
+		slog::info << "Decoding the " << slots[0].decoder->name() << " output" << slog::endl;
+
+		// With many requests in flight, the CPU runs them side by side in streams
+		// instead of spreading each inference over all the cores
+		std::map<std::string, std::string> loadConfig;
+		if (config.streams > 0 && config.device == "CPU")
+		{
+			loadConfig[PluginConfigParams::KEY_CPU_THROUGHPUT_STREAMS] = std::to_string(config.streams);
+			slog::info << "Using " << config.streams << " CPU throughput streams" << slog::endl;
+		}
+		slog::info << "Loading model to the device" << slog::endl;
+		net = ie.LoadNetwork(network, config.device, loadConfig);
+
+		for (Slot &slot : slots)
+		{
+			InferRequest::Ptr req = net.CreateInferRequestPtr();
+			// it's enough just to set image info input (if used in the model) only once
+			if (!imageInfoInputName.empty())
+			{
+				auto blob = req->GetBlob(imageInfoInputName);
+				auto data = blob->buffer().as<PrecisionTrait<Precision::FP32>::value_type *>();
+				data[0] = static_cast<float>(netInputHeight); // height
+				data[1] = static_cast<float>(netInputWidth);  // width
+				data[2] = 1;
+			}
+			slot.request = req;
+		}
+	}
+
+	const char *name() const
+	{
+		return "ie";
+	}
+
+	size_t inputWidth() const
+	{
+		return netInputWidth;
+	}
+
+	size_t inputHeight() const
+	{
+		return netInputHeight;
+	}
+
+	size_t requestCount() const
+	{
+		return slots.size();
+	}
+
+	void submit(size_t request, const cv::Mat &frame)
+	{
+		size_t framesize = frame.rows * frame.step1();
+		if (framesize != netInputWidth * netInputHeight * netInputChannel)
+		{
+			throw std::logic_error("input pixels mismatch, expecting " +
+				std::to_string(netInputWidth * netInputHeight * netInputChannel) +
+				" bytes, got: " + std::to_string(framesize));
+		}
+		Slot &slot = slots[request];
+		Blob::Ptr inputBlob = slot.request->GetBlob(imageInputName);
+		matU8ToBlob<uint8_t>(frame, inputBlob);
+		slot.request->StartAsync();
+		slot.started = true;
+	}
+
+	bool wait(size_t request, std::vector<Detection> &detections)
+	{
+		Slot &slot = slots[request];
+		if (!slot.started)
+		{
+			return false;
+		}
+		slot.started = false;
+		if (slot.request->Wait(IInferRequest::WaitMode::RESULT_READY) != OK)
+		{
+			return false;
+		}
+		const float *box = slot.request->GetBlob(outputName)->buffer().as<
+			PrecisionTrait<Precision::FP32>::value_type *>();
+		slot.decoder->decode(box, threshold, detections);
+		return true;
+	}
+
+private:
+	// Everything a request touches is its own, so that different requests can be
+	// used from different threads
+	struct Slot {
+		InferRequest::Ptr request;
+		bool started = false;
+		std::unique_ptr<OutputDecoder> decoder;
+	};
+
+	float threshold;
+	std::string imageInputName;
+	std::string outputName;
+	size_t netInputHeight;
+	size_t netInputWidth;
+	size_t netInputChannel;
+	ExecutableNetwork net;
+	std::vector<Slot> slots;
+};
+
+std::unique_ptr<InferenceBackend> createIEBackend(const BackendConfig &config)
+{
+	return std::unique_ptr<InferenceBackend>(new IEBackend(config));
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include <inference_backend.hpp>
+
+std::unique_ptr<InferenceBackend> createBackend(const BackendConfig &config)
+{
+	if (config.variants.size() > 1)
+	{
+		return createVariantBackend(config);
+	}
+	if (config.type == "ie")
+	{
+		return createIEBackend(config);
+	}
+	else if (config.type == "dnn")
+	{
+		return createDnnBackend(config);
+	}
+	else if (config.type == "synthetic")
+	{
+		return createSyntheticBackend(config);
+	}
+	else if (config.type == "remote")
+	{
+		return createRemoteBackend(config);
+	}
+	throw std::logic_error("Unknown backend " + config.type);
+}
+
+#ifndef HAVE_INFERENCE_ENGINE
+std::unique_ptr<InferenceBackend> createIEBackend(const BackendConfig &)
+{
+	throw std::logic_error("The application was built without the Inference Engine");
+}
+#endif
+
+size_t scaledInputSize(size_t size, float scale)
+{
+	if (scale == 1)
+	{
+		return size;
+	}
+	return std::max<size_t>(16, (size_t)std::lround(size * scale / 16) * 16);
+}
@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <latest_capture.hpp>
+#include <trace.hpp>
+
+typedef std::chrono::steady_clock Clock;
+
+// Delays between two attempts to reopen a lost source
+static const std::chrono::milliseconds conf_minBackoff(500);
+static const std::chrono::milliseconds conf_maxBackoff(30000);
+
+struct LatestFrameCapture::State {
+	Opener open;
+	std::chrono::milliseconds timeout;
+	std::chrono::milliseconds frameInterval;
+
+	std::mutex mutex;
+	std::condition_variable newFrame;   // Signals the caller of read()
+	std::condition_variable wake;       // Signals the watchdog
+	bool running = true;
+	bool ended = false;
+	bool degraded = false;
+	bool readerFailed = false;
+	int reconnects = 0;
+
+	// The source was reopened but its reader has not delivered a frame yet. The
+	// source only counts as reconnected with its first frame
+	bool recovering = false;
+	std::chrono::milliseconds backoff = conf_minBackoff;
+
+	// Readers of an older generation have been abandoned and exit when they can
+	long generation = 0;
+
+	// Newest captured frame
+	cv::Mat latest;
+	Clock::time_point latestTime;
+	Clock::time_point lastFrame;
+	long latestNo = 0;
+	long returnedNo = 0;
+	long dropped = 0;
+};
+
+LatestFrameCapture::LatestFrameCapture(Opener open, int timeoutMs)
+	: state(std::make_shared<State>())
+	, fps(0)
+	, width(0)
+	, height(0)
+{
+	state->open = open;
+	state->timeout = std::chrono::milliseconds(timeoutMs);
+
+	// The first opening is synchronous, so a source that does not exist is
+	// reported right away
+	cv::Ptr<cv::VideoCapture> source = open();
+	if (!source || !source->isOpened())
+	{
+		state->running = false;
+		return;
+	}
+	// The properties are read once, the source belongs to the reader thread afterwards
+	fps = source->get(cv::CAP_PROP_FPS);
+	width = source->get(cv::CAP_PROP_FRAME_WIDTH);
+	height = source->get(cv::CAP_PROP_FRAME_HEIGHT);
+	state->frameInterval = std::chrono::milliseconds(fps > 0 ? (int)(1000 / fps) + 1 : 100);
+	state->lastFrame = Clock::now();
+
+	std::thread(readLoop, state, source, 0).detach();
+	if (timeoutMs > 0)
+	{
+		std::thread(supervise, state).detach();
+	}
+}
+
+LatestFrameCapture::~LatestFrameCapture()
+{
+	release();
+}
+
+void LatestFrameCapture::readLoop(std::shared_ptr<State> state, cv::Ptr<cv::VideoCapture> source, long generation)
+{
+	traceThreadName("capture");
+	cv::Mat grabbed;
+	for (;;)
+	{
+		bool ok;
+		{
+			TRACE_SCOPE("capture read");
+			ok = source->read(grabbed);
+		}
+		Clock::time_point now = Clock::now();
+
+		std::lock_guard<std::mutex> lock(state->mutex);
+		if (!state->running || state->generation != generation)
+		{
+			break;
+		}
+		if (!ok || grabbed.empty())
+		{
+			if (state->timeout.count() > 0)
+			{
+				// Let the watchdog reopen the source
+				state->readerFailed = true;
+				state->wake.notify_all();
+			}
+			else
+			{
+				state->ended = true;
+				state->newFrame.notify_all();
+			}
+			break;
+		}
+		if (state->recovering)
+		{
+			state->recovering = false;
+			state->degraded = false;
+			state->reconnects++;
+			state->backoff = conf_minBackoff;
+		}
+		if (state->latestNo > state->returnedNo)
+		{
+			state->dropped++;
+		}
+		// The previous newest frame becomes the buffer of the next read, no copy is made
+		std::swap(state->latest, grabbed);
+		state->latestTime = now;
+		state->lastFrame = now;
+		state->latestNo++;
+		state->newFrame.notify_all();
+	}
+	source->release();
+}
+
+void LatestFrameCapture::supervise(std::shared_ptr<State> state)
+{
+	std::unique_lock<std::mutex> lock(state->mutex);
+	while (state->running)
+	{
+		bool stalled = Clock::now() - state->lastFrame > state->timeout;
+		if (!state->readerFailed && !stalled)
+		{
+			state->wake.wait_for(lock, state->timeout / 4);
+			continue;
+		}
+
+		// Abandon the current reader and its frame, and reopen the source
+		state->degraded = true;
+		state->readerFailed = false;
+		state->generation++;
+		state->returnedNo = state->latestNo;
+		state->newFrame.notify_all();
+		long generation = state->generation;
+
+		// The last reopening did not deliver any frame, whether the source could
+		// not be opened or its reader failed at once: wait before the next one
+		if (state->recovering)
+		{
+			state->wake.wait_for(lock, state->backoff, [&state]() { return !state->running; });
+			state->backoff = std::min(state->backoff * 2, conf_maxBackoff);
+			if (!state->running)
+			{
+				break;
+			}
+		}
+		state->recovering = true;
+
+		lock.unlock();
+		cv::Ptr<cv::VideoCapture> source = state->open();
+		lock.lock();
+		if (!state->running)
+		{
+			break;
+		}
+		if (source && source->isOpened())
+		{
+			state->lastFrame = Clock::now();
+			std::thread(readLoop, state, source, generation).detach();
+		}
+		else
+		{
+			state->readerFailed = true;
+		}
+	}
+}
+
+bool LatestFrameCapture::isOpened() const
+{
+	std::lock_guard<std::mutex> lock(state->mutex);
+	return (state->running && !state->ended) || state->latestNo > state->returnedNo;
+}
+
+void LatestFrameCapture::release()
+{
+	std::lock_guard<std::mutex> lock(state->mutex);
+	state->running = false;
+	state->newFrame.notify_all();
+	state->wake.notify_all();
+}
+
+bool LatestFrameCapture::grab()
+{
+	std::unique_lock<std::mutex> lock(state->mutex);
+	auto ready = [this]() {
+		return state->latestNo > state->returnedNo || state->ended || !state->running || state->degraded;
+	};
+	if (state->timeout.count() > 0)
+	{
+		state->newFrame.wait_for(lock, state->frameInterval, ready);
+	}
+	else
+	{
+		state->newFrame.wait(lock, ready);
+	}
+	return state->latestNo > state->returnedNo;
+}
+
+bool LatestFrameCapture::retrieve(cv::OutputArray image, int)
+{
+	std::lock_guard<std::mutex> lock(state->mutex);
+	if (state->latest.empty() || state->latestNo == state->returnedNo)
+	{
+		image.release();
+		return false;
+	}
+	// Copied, because the caller may still hold the buffer of its previous frame
+	state->latest.copyTo(image);
+	state->returnedNo = state->latestNo;
+	returnedTime = state->latestTime;
+	return true;
+}
+
+bool LatestFrameCapture::read(cv::OutputArray image)
+{
+	if (!grab())
+	{
+		image.release();
+		return false;
+	}
+	return retrieve(image);
+}
+
+bool LatestFrameCapture::set(int, double)
+{
+	// Seeking does not make sense on a live source
+	return false;
+}
+
+double LatestFrameCapture::get(int propId) const
+{
+	switch (propId)
+	{
+	case cv::CAP_PROP_FPS:
+		return fps;
+	case cv::CAP_PROP_FRAME_WIDTH:
+		return width;
+	case cv::CAP_PROP_FRAME_HEIGHT:
+		return height;
+	case cv::CAP_PROP_FRAME_COUNT:
+		return -1;
+	case cv::CAP_PROP_POS_FRAMES:
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		return state->returnedNo;
+	}
+	default:
+		return 0;
+	}
+}
+
+long LatestFrameCapture::droppedFrames() const
+{
+	std::lock_guard<std::mutex> lock(state->mutex);
+	return state->dropped;
+}
+
+bool LatestFrameCapture::degraded() const
+{
+	std::lock_guard<std::mutex> lock(state->mutex);
+	return state->degraded;
+}
+
+int LatestFrameCapture::reconnects() const
+{
+	std::lock_guard<std::mutex> lock(state->mutex);
+	return state->reconnects;
+}
@@ -24,27 +24,25 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <cstring>
+#include <thread>
+#include <sstream>
+#include <functional>
 #include "opencv2/opencv.hpp"
 #include "opencv2/photo/photo.hpp"
 #include "opencv2/highgui/highgui.hpp"
 #include "opencv2/video/video.hpp"
-#include <ie_icnn_net_reader.h>
-//#include <ie_device.hpp>
-#include <ie_plugin_config.hpp>
-#include <ie_plugin_dispatcher.hpp>
-#include <ie_plugin_ptr.hpp>
-#include <inference_engine.hpp>
-//#include <ie_extension.h>
-//#include <ext_list.hpp>
-#include <samples/ocv_common.hpp>
-#include <samples/slog.hpp>
 #include <nlohmann/json.hpp>
 
 #include <videocap.hpp>
+#include <allocstats.hpp>
+#include <inference_backend.hpp>
+#include <synthetic_source.hpp>
+#include <checkpoint.hpp>
+#include <trace.hpp>
+#include <batch.hpp>
 using namespace std;
 using namespace cv;
-using namespace InferenceEngine::details;
-using namespace InferenceEngine;
 bool isAsyncMode = true;
 using json = nlohmann::json;
 json jsonobj;
@@ -78,12 +76,44 @@ void parseArgs (int argc, char **argv)
 	{
 		std::cout << argv[0] << " -m MODEL -l LABELS [OPTIONS]\n\n"
 					"-m, --model	Path to .xml file containing model layers\n"
+					"-w, --weights	Path to the model weights. Default is the .bin file next to the .xml file\n"
 					"-l, --labels	Path to labels file\n"
 					"-d, --device	Device to run the inference (CPU, GPU, MYRIAD, FPGA or HDDL only)."
 					                "Default option is CPU."
 							" To run on multiple devices, use MULTI:<device1>,<device2>,<device3>\n"
 					"-f, --flag	Execution on SYNC or ASYNC mode. Default option is ASYNC mode\n"
-					"-lp, --loop	Loop video to mimic continuous input\n";
+					"-b, --backend	Inference backend: ie, dnn (OpenCV DNN), synthetic or remote"
+							" (the inference daemon). Default option is ie\n"
+					"-sk, --socket	Unix socket of the inference daemon used by the remote backend."
+							" Default option is /tmp/store-traffic-monitor.sock\n"
+					"-sz, --size	Network input size as WIDTHxHEIGHT for the dnn and synthetic backends."
+							" Default option is 300x300\n"
+					"-ps, --pixel-scale	Factor of the pixel values once the mean is subtracted, for the dnn backend."
+							" Default option is 1 for an IR, 0.007843 for other models\n"
+					"-mv, --mean-values	Comma separated mean of the pixels, like 127.5,127.5,127.5, for the dnn backend."
+							" Default option is 0 for an IR, 127.5 for other models\n"
+					"-rb, --swap-rb	Feed the dnn backend RGB frames instead of BGR\n"
+					"-ss, --synthetic-script	JSON file with the detections returned by the synthetic backend\n"
+					"-sl, --synthetic-latency	Latency of the synthetic backend in milliseconds\n"
+					"-lp, --loop	Loop video to mimic continuous input\n"
+					"-r, --replay	Process every frame deterministically and write the count series to a JSON file\n"
+					"-g, --golden	Compare the replay count series with a golden JSON file\n"
+					"-sh, --shm	Publish the frames and detections of every video in shared memory\n"
+					"-cp, --checkpoint	Directory where the counts are saved periodically and restored from on start\n"
+					"-ci, --checkpoint-interval	Seconds between two checkpoints. Default option is 5\n"
+					"-lv, --live	Always infer the newest frame of the cameras and measure the capture to count latency\n"
+					"-ma, --max-age	In live mode, discard the frames older than this number of milliseconds\n"
+					"-t, --trace	Record a timeline of the pipeline stages to a Chrome trace JSON file\n"
+					"-td, --trace-duration	Seconds of timeline recorded by --trace. Default option is until the end\n"
+					"-wd, --watchdog	Reopen the cameras that deliver no frame for this number of seconds\n"
+					"-fc, --frame-cache	Megabytes of decoded frames kept in memory for each looped video\n"
+					"-ff, --frame-cache-format	Format of the cached frames: raw or jpeg. Default option is raw\n"
+					"-rv, --resolution-variants	Comma separated input scales of the network, like 1,0.75,0.5."
+							" Every video switches between them with the load\n"
+					"-bt, --batch	Count every frame of the videos of a directory or list file offline, as fast as possible\n"
+					"-bw, --batch-workers	Videos processed in parallel in batch mode. Default option is the number of CPU cores\n"
+					"-bo, --batch-output	Directory of the batch results. Default option is batch_results\n"
+					"-bl, --batch-label	Label counted in batch mode. Default option is person\n";
 		exit(0);
 	}
 	for (int i = 1; i < argc; i += 2)
@@ -91,8 +121,57 @@ void parseArgs (int argc, char **argv)
 		if ("-m" == std::string(argv[i]) || "--model" == std::string(argv[i]))
 		{
 			conf_modelPath = std::string(argv[i + 1]);
-			int pos = conf_modelPath.rfind(".");
-			conf_binFilePath = conf_modelPath.substr(0 , pos) + ".bin";
+		}
+		else if ("-w" == std::string(argv[i]) || "--weights" == std::string(argv[i]))
+		{
+			conf_binFilePath = std::string(argv[i + 1]);
+		}
+		else if ("-b" == std::string(argv[i]) || "--backend" == std::string(argv[i]))
+		{
+			conf_backend = std::string(argv[i + 1]);
+		}
+		else if ("-sk" == std::string(argv[i]) || "--socket" == std::string(argv[i]))
+		{
+			conf_daemonSocket = std::string(argv[i + 1]);
+		}
+		else if ("-sz" == std::string(argv[i]) || "--size" == std::string(argv[i]))
+		{
+			if (sscanf(argv[i + 1], "%zux%zu", &conf_inputWidth, &conf_inputHeight) != 2)
+			{
+				std::cout << "Invalid input size " << argv[i + 1] << ", expected WIDTHxHEIGHT\n";
+				exit(14);
+			}
+		}
+		else if ("-ps" == std::string(argv[i]) || "--pixel-scale" == std::string(argv[i]))
+		{
+			conf_pixelScale = (float)atof(argv[i + 1]);
+		}
+		else if ("-mv" == std::string(argv[i]) || "--mean-values" == std::string(argv[i]))
+		{
+			std::stringstream list(argv[i + 1]);
+			std::string item;
+			conf_meanValues.clear();
+			while (getline(list, item, ','))
+			{
+				conf_meanValues.push_back((float)atof(item.c_str()));
+			}
+			if (conf_meanValues.size() != 1 && conf_meanValues.size() != 3)
+			{
+				std::cout << "Invalid mean values " << argv[i + 1] << ", expected one or three values\n";
+				exit(14);
+			}
+		}
+		else if ("-rb" == std::string(argv[i]) || "--swap-rb" == std::string(argv[i]))
+		{
+			conf_swapRB = std::string(argv[i + 1]) == "true";
+		}
+		else if ("-ss" == std::string(argv[i]) || "--synthetic-script" == std::string(argv[i]))
+		{
+			conf_syntheticScript = std::string(argv[i + 1]);
+		}
+		else if ("-sl" == std::string(argv[i]) || "--synthetic-latency" == std::string(argv[i]))
+		{
+			conf_syntheticLatency = std::stoi(argv[i + 1]);
 		}
 		else if ("-l" == std::string(argv[i]) || "--labels" == std::string(argv[i]))
 		{
@@ -113,6 +192,105 @@ void parseArgs (int argc, char **argv)
 				loopVideos = false;
 			}
 		}
+		else if ("-r" == std::string(argv[i]) || "--replay" == std::string(argv[i]))
+		{
+			conf_replayFile = std::string(argv[i + 1]);
+			replayMode = true;
+		}
+		else if ("-sh" == std::string(argv[i]) || "--shm" == std::string(argv[i]))
+		{
+			conf_shmExport = std::string(argv[i + 1]) == "true";
+		}
+		else if ("-cp" == std::string(argv[i]) || "--checkpoint" == std::string(argv[i]))
+		{
+			conf_checkpointDir = std::string(argv[i + 1]);
+		}
+		else if ("-ci" == std::string(argv[i]) || "--checkpoint-interval" == std::string(argv[i]))
+		{
+			conf_checkpointInterval = std::stoi(argv[i + 1]);
+		}
+		else if ("-lv" == std::string(argv[i]) || "--live" == std::string(argv[i]))
+		{
+			conf_liveMode = std::string(argv[i + 1]) == "true";
+		}
+		else if ("-ma" == std::string(argv[i]) || "--max-age" == std::string(argv[i]))
+		{
+			conf_maxFrameAge = std::stoi(argv[i + 1]);
+		}
+		else if ("-t" == std::string(argv[i]) || "--trace" == std::string(argv[i]))
+		{
+			conf_traceFile = std::string(argv[i + 1]);
+		}
+		else if ("-td" == std::string(argv[i]) || "--trace-duration" == std::string(argv[i]))
+		{
+			conf_traceDuration = std::stoi(argv[i + 1]);
+		}
+		else if ("-wd" == std::string(argv[i]) || "--watchdog" == std::string(argv[i]))
+		{
+			conf_watchdogTimeout = std::stoi(argv[i + 1]);
+		}
+		else if ("-fc" == std::string(argv[i]) || "--frame-cache" == std::string(argv[i]))
+		{
+			conf_frameCacheSize = std::stoul(argv[i + 1]);
+		}
+		else if ("-ff" == std::string(argv[i]) || "--frame-cache-format" == std::string(argv[i]))
+		{
+			if (std::string(argv[i + 1]) == "jpeg")
+			{
+				conf_frameCacheJpeg = true;
+			}
+			else if (std::string(argv[i + 1]) == "raw")
+			{
+				conf_frameCacheJpeg = false;
+			}
+			else
+			{
+				std::cout << "Unknown frame cache format " << argv[i + 1] << ", expected raw or jpeg\n";
+				exit(18);
+			}
+		}
+		else if ("-rv" == std::string(argv[i]) || "--resolution-variants" == std::string(argv[i]))
+		{
+			std::stringstream list(argv[i + 1]);
+			std::string item;
+			conf_resolutionScales.clear();
+			while (getline(list, item, ','))
+			{
+				float scale = (float)atof(item.c_str());
+				if (scale <= 0 || scale > 1)
+				{
+					std::cout << "Invalid resolution variant " << item << ", expected a scale above 0 and up to 1\n";
+					exit(14);
+				}
+				conf_resolutionScales.push_back(scale);
+			}
+			// The full input size always comes first
+			conf_resolutionScales.push_back(1);
+			std::sort(conf_resolutionScales.begin(), conf_resolutionScales.end(), std::greater<float>());
+			conf_resolutionScales.erase(std::unique(conf_resolutionScales.begin(), conf_resolutionScales.end()),
+				conf_resolutionScales.end());
+		}
+		else if ("-bt" == std::string(argv[i]) || "--batch" == std::string(argv[i]))
+		{
+			conf_batchInput = std::string(argv[i + 1]);
+		}
+		else if ("-bw" == std::string(argv[i]) || "--batch-workers" == std::string(argv[i]))
+		{
+			conf_batchWorkers = std::stoi(argv[i + 1]);
+		}
+		else if ("-bo" == std::string(argv[i]) || "--batch-output" == std::string(argv[i]))
+		{
+			conf_batchOutput = std::string(argv[i + 1]);
+		}
+		else if ("-bl" == std::string(argv[i]) || "--batch-label" == std::string(argv[i]))
+		{
+			conf_batchLabel = std::string(argv[i + 1]);
+		}
+		else if ("-g" == std::string(argv[i]) || "--golden" == std::string(argv[i]))
+		{
+			conf_goldenFile = std::string(argv[i + 1]);
+			replayMode = true;
+		}
 		else if ("-f" == std::string(argv[i]) || "--flag" == std::string(argv[i]))
 		{
 			if (std::string(argv[i + 1]) == "sync")
@@ -128,23 +306,33 @@ void parseArgs (int argc, char **argv)
 	}
 }
 
-// Validate the command line arguments
-void checkArgs()
+// Path of the weights of a model, by default the .bin file next to the .xml file
+static string getWeightsPath(const string &model, const string &weights)
 {
-	if (conf_modelPath.empty())
+	size_t pos = model.rfind(".");
+	if (weights.empty() && pos != string::npos && model.substr(pos) == ".xml")
 	{
-		std::cout << "You need to specify the path to the .xml file\n";
-		std::cout << "Use -m MODEL or --model MODEL or set the MODEL environment variable\n";
-		exit(11);
+		return model.substr(0 , pos) + ".bin";
 	}
+	return weights;
+}
 
-	if (conf_labelsFilePath.empty())
+// Validate the command line arguments
+void checkArgs()
+{
+	if (conf_backend.empty())
 	{
-		std::cout << "You need to specify the path to the labels file\n";
-		std::cout << "Use -l LABELS or --labels LABELS or set the LABELS environment variable\n";
-		exit(12);
+#ifdef HAVE_INFERENCE_ENGINE
+		conf_backend = "ie";
+#else
+		conf_backend = "dnn";
+#endif
 	}
 
+	// The model and the labels are checked once the config file tells which
+	// videos use the default model
+	conf_binFilePath = getWeightsPath(conf_modelPath, conf_binFilePath);
+
 	if (conf_targetDevice.empty())
 	{
 		conf_targetDevice = "CPU";
@@ -159,7 +347,54 @@ void checkArgs()
 		std::cout << "Unsupported device " << conf_targetDevice << std::endl;
 		exit(13);
 	}
+
+	// Replay is sequential and single pass so that every frame is inferred exactly once
+	if (replayMode)
+	{
+		if (conf_replayFile.empty())
+		{
+			conf_replayFile = "replay.json";
+		}
+		isAsyncMode = false;
+		loopVideos = false;
+		if (!conf_checkpointDir.empty())
+		{
+			std::cout << "Checkpoints are not used in replay mode\n";
+			conf_checkpointDir.clear();
+		}
+		if (!conf_resolutionScales.empty())
+		{
+			std::cout << "Replay mode always uses the full input size\n";
+			conf_resolutionScales.clear();
+		}
+	}
+
+	if (conf_checkpointInterval <= 0)
+	{
+		std::cout << "The checkpoint interval must be at least 1 second\n";
+		exit(15);
+	}
+
+	if (conf_maxFrameAge < 0)
+	{
+		std::cout << "The maximum frame age cannot be negative\n";
+		exit(16);
+	}
+	if (conf_watchdogTimeout < 0)
+	{
+		std::cout << "The watchdog timeout cannot be negative\n";
+		exit(16);
+	}
+	if (conf_maxFrameAge > 0 && !conf_liveMode)
+	{
+		std::cout << "The maximum frame age is only used in live mode\n";
+	}
+	if (conf_batchWorkers <= 0)
+	{
+		conf_batchWorkers = std::max(1u, std::thread::hardware_concurrency());
+	}
 }
+
 /*
 static void configureNetwork(InferenceEngine::CNNNetReader &network) {
 	try {
@@ -174,25 +409,73 @@ static void configureNetwork(InferenceEngine::CNNNetReader &network) {
 	network.getNetwork().setBatchSize(conf_batchSize);
 }
 */
-// Read the model's label file and get the position of labels required by the application
-static std::vector<bool> getUsedLabels(std::vector<VideoCap> &vidCaps, std::vector<string> *reqLabels) {
+// Get the time at which the count of a video changed. In replay mode it is the
+// position in the video timeline instead of the wall clock time
+static tm getCountTime(VideoCap &vidCap)
+{
+	tm currTime;
+	if (replayMode)
+	{
+		long sec = (long)(vidCap.vc->get(CAP_PROP_POS_MSEC) / 1000);
+		memset(&currTime, 0, sizeof(currTime));
+		currTime.tm_hour = (int)(sec / 3600);
+		currTime.tm_min = (int)(sec / 60 % 60);
+		currTime.tm_sec = (int)(sec % 60);
+	}
+	else
+	{
+		time_t t = time(nullptr);
+		localtime_r(&t, &currTime);
+	}
+	return currTime;
+}
+
+// Current time of a video in seconds, for the count statistics. Like the count
+// time it follows the video timeline in replay mode
+static double getStreamSeconds(VideoCap &vidCap)
+{
+	if (replayMode)
+	{
+		return vidCap.vc->get(CAP_PROP_POS_MSEC) / 1000;
+	}
+	return std::chrono::duration_cast<std::chrono::duration<double>>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Read the model's label file and get the position of labels required by the
+// videos of the model
+static std::vector<bool> getUsedLabels(std::vector<VideoCap> &vidCaps, const DetectionModel &model,
+	size_t modelIndex) {
 	std::vector<bool> usedLabels;
 
-	std::ifstream labelsFile(conf_labelsFilePath);
+	std::ifstream labelsFile(model.labelsFile);
 
 	if (!labelsFile.is_open()) {
-		std::cout << "Could not open labels file" << std::endl;
+		std::cout << "Could not open labels file " << model.labelsFile << std::endl;
 		return usedLabels;
 	}
 
+	std::vector<string> reqLabels;
+	for (auto &v : vidCaps) {
+		if (v.model == modelIndex) {
+			reqLabels.push_back(v.labelName);
+		}
+	}
+
 	std::string label;
 	int i = 0;
 	while (getline(labelsFile, label)) {
-		if (std::find((*reqLabels).begin(), (*reqLabels).end(), label) != (*reqLabels).end()) {
+		if (std::find(reqLabels.begin(), reqLabels.end(), label) != reqLabels.end()) {
 			usedLabels.push_back(true);
 			for (auto &v : vidCaps) {
-				if (v.labelName == label) {
+				if (v.model == modelIndex && v.labelName == label) {
 					v.label = i;
+					// Synthetic sources draw the label into their objects
+					SyntheticCapture *synthetic = dynamic_cast<SyntheticCapture *>(v.vc.get());
+					if (synthetic)
+					{
+						synthetic->setLabel(i);
+					}
 				}
 			}
 		} else {
@@ -207,7 +490,7 @@ static std::vector<bool> getUsedLabels(std::vector<VideoCap> &vidCaps, std::vect
 }
 
 // Parse the configuration file conf.txt and get the videos to be processed
-std::vector<VideoCap> getVideos (std::ifstream *file, size_t width, size_t height, vector<string> *reqLabels)
+std::vector<VideoCap> getVideos (std::ifstream *file, size_t width, size_t height)
 {
 	std::vector<VideoCap> videos;
 	std::string str;
@@ -222,19 +505,161 @@ std::vector<VideoCap> getVideos (std::ifstream *file, size_t width, size_t heigh
 		label = obj[i]["label"];
 		video_path = obj[i]["video"];
 		sprintf(camName, "Video %d", i+1);
-		if (video_path.size() == 1 && *(video_path.c_str()) >= '0' && *(video_path.c_str()) <= '9')
+		bool isCamera = !video_path.empty() && video_path.find_first_not_of("0123456789") == string::npos;
+		bool isStream = video_path.find("://") != string::npos;
+		if (SyntheticCapture::isSyntheticUrl(video_path))
+		{
+			cv::Ptr<SyntheticCapture> source = cv::makePtr<SyntheticCapture>(video_path);
+			// Replay mode reads every frame as fast as possible
+			source->setPaced(!replayMode);
+			videos.push_back(VideoCap(width, height, source, camName, label));
+		}
+		else if ((isCamera || isStream) && (conf_liveMode || conf_watchdogTimeout > 0))
+		{
+			// Cameras and network streams are read in the background in live mode
+			// and under the watchdog
+			LatestFrameCapture::Opener open;
+			if (isCamera)
+			{
+				int camera = std::stoi(video_path);
+				open = [camera]() { return cv::makePtr<cv::VideoCapture>(camera); };
+			}
+			else
+			{
+				open = [video_path]() { return cv::makePtr<cv::VideoCapture>(video_path); };
+			}
+			cv::Ptr<LatestFrameCapture> source = cv::makePtr<LatestFrameCapture>(open, conf_watchdogTimeout * 1000);
+			videos.push_back(VideoCap(width, height, source, camName, label));
+			if (conf_liveMode)
+			{
+				videos.back().live = source.get();
+			}
+			if (conf_watchdogTimeout > 0)
+			{
+				videos.back().watched = source.get();
+			}
+		}
+		else if (isCamera)
 		{
 			videos.push_back(VideoCap(width, height, std::stoi(video_path), camName, label ));
 		}
 		else
 		{
 			videos.push_back(VideoCap(width, height, video_path, camName, label ));
+			if (loopVideos && conf_frameCacheSize > 0)
+			{
+				// Decode the video once and loop it from memory
+				VideoCap &v = videos.back();
+				v.vc = cv::makePtr<CachedCapture>(v.vc, v.camName, conf_frameCacheSize * 1024 * 1024,
+					conf_frameCacheJpeg);
+			}
 		}
-		(*reqLabels).push_back(obj[i]["label"]);
+		videos.back().modelName = obj[i].value("model", "");
 	}
 	return videos;
 }
 
+// Load every model used by the videos once. Videos without a "model" entry in the
+// config file use the default model given by -m and -l; named models are described
+// in the "models" object of the config file:
+//
+//   "models": { "pedestrian": { "model": "path.xml", "labels": "labels.txt" } }
+//
+// "weights", "device", "backend", "socket", "pixelScale", "mean" and "swapRB" can be given
+// as well. Anything not given is taken from the command line
+std::vector<DetectionModel> loadModels(vector<VideoCap> &vidCaps)
+{
+	std::vector<DetectionModel> models;
+	auto modelsObj = jsonobj.value("models", json::object());
+	for (auto &v : vidCaps)
+	{
+		size_t m = 0;
+		while (m < models.size() && models[m].name != v.modelName)
+		{
+			++m;
+		}
+		v.model = m;
+		if (m < models.size())
+		{
+			continue;
+		}
+
+		DetectionModel model;
+		model.name = v.modelName;
+		model.labelsFile = conf_labelsFilePath;
+		BackendConfig &config = model.config;
+		config.type = conf_backend;
+		config.model = conf_modelPath;
+		config.weights = conf_binFilePath;
+		config.device = conf_targetDevice;
+		config.pixelScale = conf_pixelScale;
+		config.mean = conf_meanValues;
+		config.swapRB = conf_swapRB;
+		if (!v.modelName.empty())
+		{
+			if (modelsObj.find(v.modelName) == modelsObj.end())
+			{
+				std::cout << "Unknown model " << v.modelName << " for " << v.camName << std::endl;
+				exit(17);
+			}
+			auto obj = modelsObj[v.modelName];
+			config.type = obj.value("backend", conf_backend);
+			config.model = obj.value("model", "");
+			config.weights = getWeightsPath(config.model, obj.value("weights", ""));
+			config.device = obj.value("device", conf_targetDevice);
+			model.labelsFile = obj.value("labels", conf_labelsFilePath);
+			config.socket = obj.value("socket", "");
+			config.pixelScale = obj.value("pixelScale", conf_pixelScale);
+			config.mean = obj.value("mean", conf_meanValues);
+			config.swapRB = obj.value("swapRB", conf_swapRB);
+		}
+
+		if (config.model.empty() && config.type != "synthetic" && config.type != "remote")
+		{
+			if (v.modelName.empty())
+			{
+				std::cout << "You need to specify the path to the .xml file\n";
+				std::cout << "Use -m MODEL or --model MODEL or set the MODEL environment variable\n";
+			}
+			else
+			{
+				std::cout << "Model " << v.modelName << " has no \"model\" path in the config file\n";
+			}
+			exit(11);
+		}
+		if (model.labelsFile.empty())
+		{
+			std::cout << "You need to specify the path to the labels file\n";
+			std::cout << "Use -l LABELS or --labels LABELS or set the LABELS environment variable\n";
+			exit(12);
+		}
+
+		// Two requests are used, so that in async mode a frame is inferred while
+		// the result of the previous one is shown
+		config.requests = 2;
+		config.threshold = conf_thresholdValue;
+		config.inputWidth = conf_inputWidth;
+		config.inputHeight = conf_inputHeight;
+		config.script = conf_syntheticScript;
+		config.latencyMs = conf_syntheticLatency;
+		if (config.socket.empty())
+		{
+			config.socket = conf_daemonSocket;
+		}
+		// The inference daemon has a single input size
+		if (config.type != "remote")
+		{
+			config.variants = conf_resolutionScales;
+		}
+		model.backend = createBackend(config);
+		model.detections.reserve(256);
+		cout << (model.name.empty() ? "Default model" : "Model " + model.name) << ": " << config.model
+			<< " on the " << model.backend->name() << " backend" << endl;
+		models.push_back(std::move(model));
+	}
+	return models;
+}
+
 // Get the minimum fps of the videos
 int get_minFPS(std::vector<VideoCap> &vidCaps)
 {
@@ -242,7 +667,7 @@ int get_minFPS(std::vector<VideoCap> &vidCaps)
 
 	for(auto&& i : vidCaps)
 	{
-		minFPS = std::min(minFPS, (int)round(i.vc.get(CAP_PROP_FPS)));
+		minFPS = std::min(minFPS, (int)round(i.vc->get(CAP_PROP_FPS)));
 	}
 
 	return minFPS;
@@ -270,30 +695,15 @@ int saveJSON (vector<VideoCap> &vidCaps, vector<string> frameNames)
 	}
 
 	int i = 0;
-	int j;
-	char str[100];
 	dataJSON << "{\n";
 	videoJSON << "{\n";
 	int vsz = static_cast<int>(vidCaps.size());
-	int fsz;
 	for (; i < vsz; ++i)
 	{
 		if (vidCaps[i].countAtFrame.size() > 0)
 		{
-			j = 0;
 			dataJSON << "\t\"Video_" << i + 1 << "\": {\n";
-			fsz = static_cast<int>(vidCaps[i].countAtFrame.size()) - 1;
-			for (; j < fsz; ++j)
-			{
-				sprintf(str, "\t\t\"%d\": {\n\t\t\t\"count\":\"%d\",\n\t\t\t\"time\":\"%s\"\n\t\t},\n",
-								vidCaps[i].countAtFrame[j].frameNo, vidCaps[i].countAtFrame[j].count,
-								vidCaps[i].countAtFrame[j].timestamp);
-				dataJSON << str;
-			}
-			sprintf(str, "\t\t\"%d\": {\n\t\t\t\"count\":\"%d\",\n\t\t\t\"time\":\"%s\"\n\t\t}\n",
-								vidCaps[i].countAtFrame[j].frameNo, vidCaps[i].countAtFrame[j].count,
-								vidCaps[i].countAtFrame[j].timestamp);
-			dataJSON << str;
+			writeCountHistory(dataJSON, vidCaps[i].countAtFrame);
 			dataJSON << "\t},\n";
 		}
 	}
@@ -332,6 +742,10 @@ void arrangeWindows(vector<VideoCap> *vidCaps, size_t width, size_t height)
 	// Arrange video windows
 	for (int i = 0; i < (*vidCaps).size(); ++i)
 	{
+		if ((*vidCaps)[i].headless)
+		{
+			continue;
+		}
 		if (cols == conf_windowColumns)
 		{
 			cols = 0;
@@ -372,27 +786,14 @@ int saveJSON (vector<VideoCap> &vidCaps)
 	}
 
 	int i = 0;
-	int j;
-	char str[100];
 	dataJSON << "{\n";
 	int vsz = static_cast<int>(vidCaps.size());
-	int fsz;
 	for (; i < vsz; ++i)
 	{
 		if (vidCaps[i].countAtFrame.size() > 0)
 		{
-			j = 0;
 			dataJSON << "\t\"Video_" << i + 1 << "\": {\n";
-			fsz = static_cast<int>(vidCaps[i].countAtFrame.size()) - 1;
-			for (; j < fsz; ++j)
-			{
-				sprintf(str, "\t\t\"%.2f\" : \"%d\",\n", (float)vidCaps[i].countAtFrame[j].first /
-				                vidCaps[i].vc.get(cv::CAP_PROP_FPS),	vidCaps[i].countAtFrame[j].second);
-				dataJSON << str;
-			}
-			sprintf(str, "\t\t\"%.2f\" : \"%d\"\n",	(float)vidCaps[i].countAtFrame[j].first /
-			                vidCaps[i].vc.get(cv::CAP_PROP_FPS), vidCaps[i].countAtFrame[j].second);
-			dataJSON << str;
+			writeCountHistory(dataJSON, vidCaps[i].countAtFrame, vidCaps[i].vc->get(cv::CAP_PROP_FPS));
 			dataJSON << "\t},\n";
 		}
 	}
@@ -410,128 +811,432 @@ int saveJSON (vector<VideoCap> &vidCaps)
 }
 #endif
 
+// Convert between the count history of a video and its checkpoint records
+#ifdef UI_OUTPUT
+static CountRecord toCountRecord(const frameInfo &fr)
+{
+	CountRecord r;
+	r.frameNo = fr.frameNo;
+	r.count = fr.count;
+	snprintf(r.timestamp, sizeof(r.timestamp), "%s", fr.timestamp);
+	return r;
+}
+
+static frameInfo fromCountRecord(const CountRecord &r)
+{
+	frameInfo fr;
+	fr.frameNo = r.frameNo;
+	fr.count = r.count;
+	snprintf(fr.timestamp, sizeof(fr.timestamp), "%s", r.timestamp);
+	return fr;
+}
+#else
+static CountRecord toCountRecord(const pair<int, int> &fr)
+{
+	CountRecord r;
+	r.frameNo = fr.first;
+	r.count = fr.second;
+	r.timestamp[0] = '\0';
+	return r;
+}
 
-int main(int argc, char **argv)
+static pair<int, int> fromCountRecord(const CountRecord &r)
 {
+	return make_pair(r.frameNo, r.count);
+}
+#endif
 
-	vector<bool> noMoreData;
-	int index = 0;
-	parseEnv();
-	parseArgs(argc, argv);
-	checkArgs();
+static StreamCounters getCounters(const VideoCap &vidCap)
+{
+	StreamCounters c;
+	memset(&c, 0, sizeof(c));
+	snprintf(c.label, sizeof(c.label), "%s", vidCap.labelName.c_str());
+	c.totalCount = vidCap.totalCount;
+	c.lastCorrectCount = vidCap.lastCorrectCount;
+	c.frames = vidCap.frames;
+	c.loopFrames = vidCap.loopFrames;
+	c.historySize = vidCap.checkpointedHistory;
+	return c;
+}
 
-	std::ifstream confFile(conf_file);
-	if (!confFile.is_open())
+// Restore the counters from the last checkpoint and start checkpointing
+void startCheckpoints(vector<VideoCap> &vidCaps, Checkpointer &checkpointer)
+{
+	vector<StreamCounters> counters;
+	for (auto &vidCapObj : vidCaps)
 	{
-		cout << "Could not open config file" << endl;
-		return 2;
+		counters.push_back(getCounters(vidCapObj));
+	}
+
+	vector<vector<CountRecord>> history;
+	if (checkpointer.restore(counters, history))
+	{
+		for (size_t i = 0; i < vidCaps.size(); ++i)
+		{
+			VideoCap &v = vidCaps[i];
+			v.totalCount = counters[i].totalCount;
+			v.lastCorrectCount = counters[i].lastCorrectCount;
+			v.currentCount = v.lastCorrectCount;
+			v.candidateCount = v.lastCorrectCount;
+			v.frames = counters[i].frames;
+			v.countAtFrame.clear();
+			for (auto &r : history[i])
+			{
+				v.countAtFrame.push_back(fromCountRecord(r));
+			}
+			v.checkpointedHistory = v.countAtFrame.size();
+			// Files continue from where they were, cameras just keep the counts
+			if (!v.isCam)
+			{
+				v.loopFrames = counters[i].loopFrames;
+				v.vc->set(CAP_PROP_POS_FRAMES, v.loopFrames);
+			}
+			v.aggregator.update(getStreamSeconds(v), v.lastCorrectCount, v.totalCount);
+			cout << v.camName << ": restored " << v.labelName << " count " << v.lastCorrectCount
+				<< ", total " << v.totalCount << endl;
+		}
 	}
+	checkpointer.start(counters);
+}
 
-	// Load the IE plugin for the target device
-	Core ie;
-	auto network = ie.ReadNetwork(conf_modelPath);
+// Hand the new state of a video to the checkpointer. Only the history entries
+// added since the last call are passed on
+void checkpointCounts(VideoCap &vidCap, size_t stream, Checkpointer &checkpointer)
+{
+	CountRecord records[16];
+	do
+	{
+		size_t n = 0;
+		while (n < 16 && vidCap.checkpointedHistory < vidCap.countAtFrame.size())
+		{
+			records[n++] = toCountRecord(vidCap.countAtFrame[vidCap.checkpointedHistory++]);
+		}
+		checkpointer.update(stream, getCounters(vidCap), records, n);
+	} while (vidCap.checkpointedHistory < vidCap.countAtFrame.size());
+}
 
-        network.setBatchSize(conf_batchSize);
-/*
-	if ((conf_targetDevice.find("CPU") != std::string::npos))
+// Write the windowed count statistics of every video. The dashboards read this
+// small summary instead of walking the whole count history
+int writeSummary (vector<VideoCap> &vidCaps)
+{
+	json summary;
+	for (size_t i = 0; i < vidCaps.size(); ++i)
 	{
-		// Required for support of certain layers in CPU
-		ie.AddExtension(std::make_shared<Extensions::Cpu::CpuExtensions>(), "CPU");
+		VideoCap &v = vidCaps[i];
+		double now = getStreamSeconds(v);
+		CountAggregator &agg = v.aggregator;
+		json buckets = json::array();
+		for (auto &b : agg.buckets(now))
+		{
+			buckets.push_back({{"start", (long)(b.index * agg.bucketLength())}, {"entries", b.entries},
+				{"peak", b.peak}});
+		}
+		string name = "Video_" + to_string(i + 1);
+		summary[name] = {
+			{"label", v.labelName},
+			{"current", v.lastCorrectCount},
+			{"total", v.totalCount},
+			{"averageOccupancy", agg.averageOccupancy(now)},
+			{"windowPeak", agg.windowPeak(now)},
+			{"windowEntries", agg.windowEntries(now)},
+			{"peak", agg.peak()},
+			{"buckets", buckets}
+		};
+		if (v.live)
+		{
+			summary[name]["latency"] = {
+				{"last", v.latency},
+				{"average", v.latencyFrames ? v.latencySum / v.latencyFrames : 0},
+				{"max", v.latencyMax},
+				{"staleFrames", v.staleFrames},
+				{"droppedFrames", v.live->droppedFrames()}
+			};
+		}
+		if (v.resolution.variants() > 1)
+		{
+			summary[name]["resolution"] = {
+				{"input", to_string(v.networkInput.width) + "x" + to_string(v.networkInput.height)},
+				{"variant", v.resolution.variant()},
+				{"load", v.resolution.load()},
+				{"switches", v.resolution.switches()}
+			};
+		}
+		if (v.watched)
+		{
+			summary[name]["degraded"] = v.degraded;
+			summary[name]["reconnects"] = v.watched->reconnects();
+		}
+	}
+
+	// Written to a temporary file first, so the UI never reads a partial summary
+	string tmpFile = conf_summaryJSON_file + ".tmp";
+	ofstream summaryJSON(tmpFile);
+	if (!summaryJSON.is_open())
+	{
+		cout << "Could not open summary file" << endl;
+		return 5;
+	}
+	summaryJSON << summary.dump(1, '\t');
+	summaryJSON.close();
+	rename(tmpFile.c_str(), conf_summaryJSON_file.c_str());
+	return 0;
+}
+
+// Write the count series of every video, as recorded in replay mode
+int saveReplay (vector<VideoCap> &vidCaps, json *replay)
+{
+	ofstream replayJSON(conf_replayFile);
+	if (!replayJSON.is_open())
+	{
+		cout << "Could not open replay file " << conf_replayFile << endl;
+		return 5;
 	}
-*/
-	InputsDataMap inputInfo(network.getInputsInfo());
 
-	std::string imageInputName, imageInfoInputName;
-	size_t netInputHeight, netInputWidth, netInputChannel;
+	for (size_t i = 0; i < vidCaps.size(); ++i)
+	{
+		json series = json::array();
+		for (auto &c : vidCaps[i].countAtFrame)
+		{
+#ifdef UI_OUTPUT
+			series.push_back({c.frameNo, c.count, c.timestamp});
+#else
+			series.push_back({c.first, c.second});
+#endif
+		}
+		string name = "Video_" + to_string(i + 1);
+		(*replay)[name]["label"] = vidCaps[i].labelName;
+		(*replay)[name]["countAtFrame"] = series;
+		(*replay)[name]["totalCount"] = vidCaps[i].totalCount;
+	}
 
-	for (const auto &inputInfoItem : inputInfo)
+	replayJSON << replay->dump(1, '\t') << endl;
+	replayJSON.close();
+	return 0;
+}
+
+// Compare the replay results with the golden results and report the differences
+int compareGolden (const json &replay)
+{
+	std::ifstream goldenFile(conf_goldenFile);
+	if (!goldenFile.is_open())
 	{
-		if (inputInfoItem.second->getInputData()->getTensorDesc().getDims().size() ==4)
-		{ // first input contains images
-			imageInputName = inputInfoItem.first;
-			inputInfoItem.second->setPrecision(Precision::U8);
-			inputInfoItem.second->getInputData()->setLayout(Layout::NCHW);
-			const TensorDesc &inputDesc = inputInfoItem.second->getTensorDesc();
-			netInputHeight = getTensorHeight(inputDesc);
-			netInputWidth = getTensorWidth(inputDesc);
-			netInputChannel = getTensorChannels(inputDesc);
+		cout << "Could not open golden file " << conf_goldenFile << endl;
+		return 5;
+	}
+	json golden;
+	goldenFile >> golden;
+
+	int mismatches = 0;
+	for (auto it = golden.begin(); it != golden.end(); ++it)
+	{
+		if (replay.find(it.key()) == replay.end())
+		{
+			cout << it.key() << ": missing from the replay results" << endl;
+			++mismatches;
+			continue;
 		}
-		else if (inputInfoItem.second->getTensorDesc().getDims().size() == 2) { // second input contains image info
-			imageInfoInputName = inputInfoItem.first;
-			inputInfoItem.second->setPrecision(Precision::FP32);
+		const json &res = replay[it.key()];
+		if (res["totalCount"] != (*it)["totalCount"])
+		{
+			cout << it.key() << ": totalCount " << res["totalCount"] << ", expected " << (*it)["totalCount"] << endl;
+			++mismatches;
 		}
-		else
+		const json &expected = (*it)["countAtFrame"];
+		const json &actual = res["countAtFrame"];
+		size_t n = std::min(expected.size(), actual.size());
+		for (size_t j = 0; j < n; ++j)
 		{
-			throw std::logic_error(
-				"Unsupported " +
-				std::to_string(
-				inputInfoItem.second->getTensorDesc().getDims().size()) +
-				"D "
-				"input layer '" +
-				inputInfoItem.first + "'. "
-				"Only 2D and 4D input layers are supported");
-		}
-	}
-
-	OutputsDataMap outputInfo(network.getOutputsInfo());
-	if (outputInfo.size() != 1) {
-		throw std::logic_error("This demo accepts networks having only one output");
-	}
-	DataPtr &output = outputInfo.begin()->second;
-	auto outputName = outputInfo.begin()->first;
-	//const int num_classes = network.getNetwork().getLayerByName(outputName.c_str())->GetParamAsInt("num_classes");
-	const SizeVector outputDims = output->getTensorDesc().getDims();
-	const int maxProposalCount = outputDims[2];
-
-	const int objectSize = outputDims[3];
-	if (objectSize != 7) {
-		throw std::logic_error("Output should have 7 as a last dimension");
-	}
-	if (outputDims.size() != 4) {
-		throw std::logic_error("Incorrect output dimensions for SSD");
-	}
-	output->setPrecision(Precision::FP32);
-	output->setLayout(Layout::NCHW);
-
-	// -----------------------------------------------------------------------------------------------------
-
-	// --------------------------- 4. Loading model to the device
-	// -----------------------------------------------------------------------------------------------------
-	slog::info << "Loading model to the device" << slog::endl;
-	ExecutableNetwork net =	ie.LoadNetwork(network, conf_targetDevice);
-	// -----------------------------------------------------------------------------------------------------
-
-	// --------------------------- 5. Create infer request
-	// -----------------------------------------------------------------------------------------------------
-	InferenceEngine::InferRequest::Ptr currInfReq = net.CreateInferRequestPtr();
-	InferenceEngine::InferRequest::Ptr nextInfReq = net.CreateInferRequestPtr();
-
-	// ----------------------
-	// get output dimensions
-	// ----------------------
-	/* it's enough just to set image info input (if used in the model) only once
-	*/
-	if (!imageInfoInputName.empty()) {
-		auto setImgInfoBlob = [&](const InferRequest::Ptr &inferReq) {
-			auto blob = inferReq->GetBlob(imageInfoInputName);
-			auto data =	blob->buffer().as<PrecisionTrait<Precision::FP32>::value_type *>();
-			data[0] = static_cast<float>(netInputHeight); // height
-			data[1] = static_cast<float>(netInputWidth);  // width
-			data[2] = 1;
-		};
-		setImgInfoBlob(currInfReq);
-		setImgInfoBlob(nextInfReq);
+			if (expected[j] != actual[j])
+			{
+				cout << it.key() << ": countAtFrame[" << j << "] " << actual[j].dump() << ", expected " << expected[j].dump() << endl;
+				++mismatches;
+				break;
+			}
+		}
+		if (expected.size() != actual.size())
+		{
+			cout << it.key() << ": " << actual.size() << " count changes, expected " << expected.size() << endl;
+			++mismatches;
+		}
+	}
+	if (replay.size() != golden.size())
+	{
+		cout << replay.size() << " videos replayed, expected " << golden.size() << endl;
+		++mismatches;
 	}
 
-	// Create VideoCap objects for all cams
-	std::vector<VideoCap> vidCaps;
+	if (mismatches)
+	{
+		cout << "Replay does not match " << conf_goldenFile << endl;
+		return 6;
+	}
+	cout << "Replay matches " << conf_goldenFile << endl;
+	return 0;
+}
 
-	// Requested label for each video
-	std::vector<string> reqLabels;
+// Print the heap allocations per frame of the main loop after the warm-up
+void reportAllocStats(int frames, size_t warmCount, size_t warmBytes)
+{
+#ifdef ALLOC_STATS
+	if (frames <= 0)
+	{
+		cout << "Not enough frames processed to measure allocations" << endl;
+		return;
+	}
+	cout << "Allocations per frame after warm-up: " << (double)(allocStatsCount() - warmCount) / frames
+		<< " (" << (double)(allocStatsBytes() - warmBytes) / frames << " bytes)" << endl;
+#else
+	(void)frames;
+	(void)warmCount;
+	(void)warmBytes;
+#endif
+}
+
+// Stop the timeline recording and write it
+void finishTrace()
+{
+	if (conf_traceFile.empty() || !traceActive)
+	{
+		return;
+	}
+	traceStop();
+	if (traceWrite(conf_traceFile))
+	{
+		cout << "Timeline written to " << conf_traceFile << endl;
+	}
+	else
+	{
+		cout << "Could not write timeline " << conf_traceFile << endl;
+	}
+}
+
+// Print the capture to count latency of the live cameras
+void reportLatency(vector<VideoCap> &vidCaps)
+{
+	for (auto &v : vidCaps)
+	{
+		if (!v.live)
+		{
+			continue;
+		}
+		cout << v.camName << " latency: average " << (v.latencyFrames ? v.latencySum / v.latencyFrames : 0)
+			<< " ms, max " << v.latencyMax << " ms, " << v.staleFrames << " stale frames discarded, "
+			<< v.live->droppedFrames() << " frames dropped by the capture" << endl;
+	}
+}
+
+// Feed the load of the frame of a video just counted to its resolution controller.
+// The time the main loop spends waiting for the cameras is not load. Returns true when the video changes variant
+bool updateResolution(VideoCap &v, InferenceBackend &backend, double idleMs)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double busy = std::chrono::duration<double, std::milli>(now - v.resolutionTime).count() -
+		(idleMs - v.resolutionIdle);
+	v.resolutionTime = now;
+	v.resolutionIdle = idleMs;
+	if (!v.resolution.update(busy, v.live ? v.latency : 0))
+	{
+		return false;
+	}
+	v.networkInput = backend.variantSize(v.resolution.variant());
+	return true;
+}
+
+// Count the videos given by --batch offline, without the config file and the
+// windows. All the workers share one loaded model, each one with its own request
+int runBatchMode()
+{
+	BackendConfig config;
+	config.type = conf_backend;
+	config.model = conf_modelPath;
+	config.weights = conf_binFilePath;
+	config.device = conf_targetDevice;
+	if (config.model.empty() && config.type != "synthetic" && config.type != "remote")
+	{
+		std::cout << "You need to specify the path to the .xml file\n";
+		std::cout << "Use -m MODEL or --model MODEL or set the MODEL environment variable\n";
+		return 11;
+	}
+	if (conf_labelsFilePath.empty())
+	{
+		std::cout << "You need to specify the path to the labels file\n";
+		std::cout << "Use -l LABELS or --labels LABELS or set the LABELS environment variable\n";
+		return 12;
+	}
+	config.requests = conf_batchWorkers;
+	config.streams = conf_batchWorkers;
+	config.threshold = conf_thresholdValue;
+	config.inputWidth = conf_inputWidth;
+	config.inputHeight = conf_inputHeight;
+	config.script = conf_syntheticScript;
+	config.latencyMs = conf_syntheticLatency;
+	config.socket = conf_daemonSocket;
+	config.pixelScale = conf_pixelScale;
+	config.mean = conf_meanValues;
+	config.swapRB = conf_swapRB;
+	std::unique_ptr<InferenceBackend> backend = createBackend(config);
+	cout << "Batch model: " << config.model << " on the " << backend->name() << " backend" << endl;
+
+	BatchConfig batch;
+	batch.input = conf_batchInput;
+	batch.outputDir = conf_batchOutput;
+	batch.labelsFile = conf_labelsFilePath;
+	batch.label = conf_batchLabel;
+	batch.workers = conf_batchWorkers;
+	batch.candidateConfidence = conf_candidateConfidence;
+
+	traceThreadName("main");
+	if (!conf_traceFile.empty())
+	{
+		traceStart(conf_traceEvents);
+	}
+	int ret = runBatch(batch, *backend);
+	finishTrace();
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+
+	vector<bool> noMoreData;
+	int index = 0;
+	parseEnv();
+	parseArgs(argc, argv);
+	checkArgs();
+	if (!conf_batchInput.empty())
+	{
+		return runBatchMode();
+	}
 
-	vidCaps = getVideos(&confFile, netInputHeight, netInputWidth, &reqLabels);
-	const size_t input_width = vidCaps[0].vc.get(CAP_PROP_FRAME_WIDTH);
-	const size_t input_height = vidCaps[0].vc.get(CAP_PROP_FRAME_HEIGHT);
+	std::ifstream confFile(conf_file);
+	if (!confFile.is_open())
+	{
+		cout << "Could not open config file" << endl;
+		return 2;
+	}
+
+	// Create VideoCap objects for all cams
+	std::vector<VideoCap> vidCaps;
+	vidCaps = getVideos(&confFile, conf_inputWidth, conf_inputHeight);
+
+	// Load the models on their inference backends. The displayed frames have the
+	// input size of the model of the first video
+	std::vector<DetectionModel> models = loadModels(vidCaps);
+	const size_t netInputWidth = models[vidCaps[0].model].backend->inputWidth();
+	const size_t netInputHeight = models[vidCaps[0].model].backend->inputHeight();
+	if (replayMode)
+	{
+		for (auto &vidCapObj : vidCaps)
+		{
+			if (vidCapObj.isCam)
+			{
+				cout << "Replay mode works only with video files, not with " << vidCapObj.camName << endl;
+				return 2;
+			}
+		}
+	}
+	const size_t input_width = vidCaps[0].vc->get(CAP_PROP_FRAME_WIDTH);
+	const size_t input_height = vidCaps[0].vc->get(CAP_PROP_FRAME_HEIGHT);
 	const size_t output_width = netInputWidth;
 	const size_t output_height = netInputHeight;
 
@@ -539,9 +1244,14 @@ int main(int argc, char **argv)
 	int waitTime = (int)(round(1000 / minFPS / vidCaps.size()));
 
 #ifndef UI_OUTPUT
-	// Create video writer for every input source
+	// Create video writer for every input source but the synthetic ones, which
+	// have no window either. Without any video window, there is no statistics window
+	bool showWindows = false;
 	for (auto &vidCapObj : vidCaps)
 	{
+		if (replayMode || vidCapObj.headless)
+			continue;
+		showWindows = true;
 		if(!vidCapObj.initVW(output_height, output_width, minFPS))
 		{
 			cout << "Could not open " << vidCapObj.videoName << " for writing\n";
@@ -549,58 +1259,169 @@ int main(int argc, char **argv)
 		}
 	}
 
-	namedWindow("Statistics", WINDOW_AUTOSIZE);
-
-	arrangeWindows(&vidCaps, output_width, output_height + 4);
-	Mat stats;
+	if (showWindows)
+	{
+		namedWindow("Statistics", WINDOW_AUTOSIZE);
+		arrangeWindows(&vidCaps, output_width, output_height + 4);
+	}
+	Mat stats(output_height > (vidCaps.size() * 20 + 15) ? output_height : (vidCaps.size() * 20 + 15),
+		output_width > 345 ? output_width : 345, CV_8UC1, Scalar(0));
 #endif
-	Mat frameInfer;
-	Mat frame, prev_frame;
 	Mat *output_frames = new Mat[conf_batchSize];
 
-	auto input_channels = netInputChannel; // Channels for color format, RGB=4
-	auto channel_size = output_width * output_height;
-	auto input_size = channel_size * input_channels;
 	bool no_more_data = false;
 
 	// Read class names
-	std::vector<bool> usedLabels = getUsedLabels(vidCaps, &reqLabels);
-	if (usedLabels.empty()) {
-		std::cout << "Error: No labels currently in use. Please check your path."
-		<< std::endl;
-		return 1;
+	for (size_t m = 0; m < models.size(); ++m)
+	{
+		models[m].usedLabels = getUsedLabels(vidCaps, models[m], m);
+		if (models[m].usedLabels.empty()) {
+			std::cout << "Error: No labels currently in use. Please check your path."
+			<< std::endl;
+			return 1;
+		}
+	}
+
+	if (conf_shmExport)
+	{
+		for (auto &vidCapObj : vidCaps)
+		{
+			string shmName = "/stm_" + vidCapObj.camName;
+			replace(shmName.begin(), shmName.end(), ' ', '_');
+			vidCapObj.shm = std::make_shared<ShmExporter>(shmName, vidCapObj.camName, vidCapObj.labelName,
+				vidCapObj.label);
+			cout << vidCapObj.camName << " is published in shared memory " << shmName << endl;
+		}
+	}
+
+	std::unique_ptr<Checkpointer> checkpointer;
+	if (!conf_checkpointDir.empty())
+	{
+		checkpointer.reset(new Checkpointer(conf_checkpointDir, vidCaps.size(), conf_checkpointInterval * 1000));
+		startCheckpoints(vidCaps, *checkpointer);
 	}
 
 #ifdef UI_OUTPUT
 	vector<string> frameNames;
 #else
-	list<string> logList;
 	int rollingLogSize = (output_height - 15) / 20;
+	RollingLog logList(rollingLogSize > 0 ? rollingLogSize : 0);
 #endif
 
+	// Allocations are counted only after the warm-up frames, when the frame pools
+	// and the scratch buffers have reached their final size
+	const int allocWarmupFrames = 100;
+	int processedFrames = 0;
+	size_t warmAllocCount = 0;
+	size_t warmAllocBytes = 0;
+	allocStatsTrackThread();
+
+	traceThreadName("main");
+	if (!conf_traceFile.empty())
+	{
+		traceStart(conf_traceEvents);
+	}
+	std::chrono::steady_clock::time_point traceEnd = std::chrono::steady_clock::now() +
+		std::chrono::seconds(conf_traceDuration);
+
 	for (auto &vidCapObj : vidCaps)
 	{
+		// The load of a video is measured against the time between two of the
+		// frames it reads, see the skip of the main loop
+		InferenceBackend &backend = *models[vidCapObj.model].backend;
+		vector<double> cost;
+		for (size_t i = 0; i < backend.variantCount(); ++i)
+		{
+			cost.push_back(backend.variantSize(i).area());
+		}
+		int vfps = (int)round(vidCapObj.vc->get(CAP_PROP_FPS));
+		int skip = (replayMode || vidCapObj.live || vidCapObj.watched) ? 1 : std::max(1, (int)round(vfps / minFPS));
+		vidCapObj.resolution = ResolutionController(cost, vfps > 0 ? 1000.0 * skip / vfps : 1000.0 / 30);
+		vidCapObj.networkInput = backend.variantSize(0);
+		vidCapObj.resolutionTime = std::chrono::steady_clock::now();
+
 		vidCapObj.t1 = std::chrono::high_resolution_clock::now();
+		vidCapObj.aggregator.update(getStreamSeconds(vidCapObj), vidCapObj.lastCorrectCount, vidCapObj.totalCount);
 		noMoreData.push_back(false);
 	}
+	std::chrono::steady_clock::time_point lastSummary = std::chrono::steady_clock::now();
 	if (isAsyncMode)
 		std::cout << "Application running in Async Mode" << std::endl;
 	else
 		std::cout << "Application running in sync Mode" << std::endl;
 
-	VideoCap *prevVideoCap;
 	typedef std::chrono::duration<double,std::ratio<1, 1000>> ms;
+	// Time spent waiting for the cameras, in milliseconds
+	double idleMs = 0;
 
 	// Main loop starts here
 	for (;;) {
 		index = 0;
+		bool submitted = false;
 		for (auto &vidCapObj : vidCaps) {
+			// Pipeline of the model of this video
+			DetectionModel &model = models[vidCapObj.model];
+			InferenceBackend *backend = model.backend.get();
+			VideoCap *&prevVideoCap = model.prevVideoCap;
+			Mat &prev_frame = model.prev_frame;
+			std::chrono::steady_clock::time_point &prevFrameTime = model.prevFrameTime;
+			size_t &currReq = model.currReq;
+			size_t &nextReq = model.nextReq;
+			vector<Detection> &detections = model.detections;
+			const vector<bool> &usedLabels = model.usedLabels;
+
 			// Get a new frame
-			int vfps = (int)round(vidCapObj.vc.get(CAP_PROP_FPS));
-			for (int i = 0; i < round(vfps / minFPS); ++i)
+			int vfps = (int)round(vidCapObj.vc->get(CAP_PROP_FPS));
+			// Cameras read in the background already return their newest frame
+			int skip = (replayMode || vidCapObj.live || vidCapObj.watched) ? 1 : (int)round(vfps / minFPS);
+			Mat &frame = vidCapObj.framePool.acquire();
+			const int stream = index;
 			{
-				vidCapObj.vc.read(frame);
-				vidCapObj.loopFrames++;
+				TRACE_SCOPE("read", stream, vidCapObj.loopFrames);
+				std::chrono::steady_clock::time_point readStart = std::chrono::steady_clock::now();
+				for (int i = 0; i < skip; ++i)
+				{
+					vidCapObj.vc->read(frame);
+					vidCapObj.loopFrames++;
+				}
+				// A camera read in the foreground blocks until its next frame
+				if (vidCapObj.isCam && !vidCapObj.live && !vidCapObj.watched)
+				{
+					idleMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - readStart).count();
+				}
+			}
+
+			if (vidCapObj.watched && vidCapObj.watched->degraded() != vidCapObj.degraded)
+			{
+				vidCapObj.degraded = !vidCapObj.degraded;
+				tm countTime = getCountTime(vidCapObj);
+				char str[64];
+				snprintf(str, sizeof(str), "%02d:%02d:%02d - %s %s", countTime.tm_hour, countTime.tm_min,
+					countTime.tm_sec, vidCapObj.camName.c_str(), vidCapObj.degraded ? "lost, reconnecting" : "reconnected");
+				cout << str << endl;
+#ifndef UI_OUTPUT
+				logList.add(str);
+#endif
+			}
+
+			if (!frame.data && vidCapObj.watched && vidCapObj.watched->isOpened())
+			{
+				// No new frame from a watched camera: the other videos do not wait for it
+				++index;
+#ifndef UI_OUTPUT
+				if (vidCapObj.degraded)
+				{
+					if (vidCapObj.degradedMessage.empty())
+					{
+						vidCapObj.degradedMessage = Mat(output_height, output_width, CV_8UC1, Scalar(0));
+						std::string message = "Video stream from " + vidCapObj.camName + " is lost, reconnecting";
+						cv::putText(vidCapObj.degradedMessage, message, Point(15, output_height / 2),
+								cv::FONT_HERSHEY_COMPLEX, 0.4, Scalar(255, 255, 255), 1, 8 , false);
+					}
+					imshow(vidCapObj.camName, vidCapObj.degradedMessage);
+				}
+#endif
+				continue;
 			}
 
 			if (!frame.data) {
@@ -615,16 +1436,34 @@ int main(int argc, char **argv)
 			// inputPtr -> a pointer to pre-allocated inout buffer
 			if (noMoreData[index]){
 				++index;
+				if (replayMode || vidCapObj.headless)
+					continue;
 #ifndef UI_OUTPUT
-				Mat messageWindow = Mat(output_height, output_width, CV_8UC1, Scalar(0));
-				std::string message = "Video stream from " + vidCapObj.camName + " has ended!";
-				cv::putText(messageWindow, message, Point(15, output_height / 2),
-						cv::FONT_HERSHEY_COMPLEX, 0.4, (255, 255, 255), 1, 8 , false);
-				imshow(vidCapObj.camName, messageWindow);
+				if (vidCapObj.endMessage.empty())
+				{
+					vidCapObj.endMessage = Mat(output_height, output_width, CV_8UC1, Scalar(0));
+					std::string message = "Video stream from " + vidCapObj.camName + " has ended!";
+					cv::putText(vidCapObj.endMessage, message, Point(15, output_height / 2),
+							cv::FONT_HERSHEY_COMPLEX, 0.4, Scalar(255, 255, 255), 1, 8 , false);
+				}
+				imshow(vidCapObj.camName, vidCapObj.endMessage);
 #endif
 				continue;
 			}
-			Blob::Ptr inputBlob;
+
+			if (vidCapObj.live)
+			{
+				// A frame that waited too long is not worth inferring any more
+				vidCapObj.frameTime = vidCapObj.live->frameTime();
+				if (conf_maxFrameAge > 0 &&
+				    std::chrono::steady_clock::now() - vidCapObj.frameTime > std::chrono::milliseconds(conf_maxFrameAge))
+				{
+					vidCapObj.staleFrames++;
+					++index;
+					continue;
+				}
+			}
+
 			vidCapObj.frame = frame;
 			vidCapObj.inputWidth = frame.cols;
 			vidCapObj.inputHeight = frame.rows;
@@ -634,41 +1473,28 @@ int main(int argc, char **argv)
 			//----------------------------------------------
 
 			// Input frame is resized to infer resolution
-			resize(vidCapObj.frame, frameInfer, Size(output_width, output_height));
-			if (isAsyncMode)
+			Mat &frameInfer = model.frameInfer;
 			{
-				inputBlob = nextInfReq->GetBlob(imageInputName);
+				TRACE_SCOPE("resize", stream, vidCapObj.loopFrames);
+				resize(vidCapObj.frame, frameInfer, vidCapObj.networkInput);
 			}
-			else
+			if (!isAsyncMode)
 			{
-				inputBlob = currInfReq->GetBlob(imageInputName);
 				prevVideoCap = &vidCapObj;
 				prev_frame = vidCapObj.frame;
-			}
-			matU8ToBlob<uint8_t>(frameInfer, inputBlob);
-
-			//------------------------------------------------------
-			// PREPROCESS STAGE:
-			// Convert image to format expected by inference engine
-			// IE expects planar, convert from packed
-			//------------------------------------------------------
-			size_t framesize = frameInfer.rows * frameInfer.step1();
-
-			if (framesize != input_size)
-			{
-				std::cout << "input pixels mismatch, expecting " << input_size
-					<< " bytes, got: " << framesize << endl;
-				return 1;
+				prevFrameTime = vidCapObj.frameTime;
+				model.prevFrameNo = vidCapObj.loopFrames;
 			}
 
 			//---------------------------
 			// INFER STAGE
 			//---------------------------
 			std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
-			if (isAsyncMode)
-				nextInfReq->StartAsync();
-			else
-				currInfReq->StartAsync();
+			{
+				TRACE_SCOPE("submit", stream, vidCapObj.loopFrames);
+				backend->submit(isAsyncMode ? nextReq : currReq, frameInfer);
+			}
+			submitted = true;
 
 			std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
 			ms infer_time = std::chrono::duration_cast<ms>(t2 - t1);
@@ -682,43 +1508,51 @@ int main(int argc, char **argv)
 			int frames = vidCapObj.frames;
 #endif
 
-			if (currInfReq->Wait(IInferRequest::WaitMode::RESULT_READY) == OK) {
+			bool ready;
+			{
+				// The results are those of the previous frame of the model
+				TRACE_SCOPE("wait", prevVideoCap ? (int)(prevVideoCap - &vidCaps[0]) : -1, model.prevFrameNo);
+				ready = backend->wait(currReq, detections);
+			}
+			if (ready) {
+				const int prevStream = prevVideoCap - &vidCaps[0];
+				const int prevFrameNo = model.prevFrameNo;
 
-				float *box = currInfReq->GetBlob(outputName)->buffer().as<InferenceEngine::PrecisionTrait<
-					InferenceEngine::Precision::FP32>::value_type *>();
-				prevVideoCap->currentCount = 0;
 				prevVideoCap->changedCount = false;
 
 				//---------------------------
-				// Parse SSD output
+				// Count the detections of the video's label
 				//---------------------------
-				for (int c = 0; c < maxProposalCount; c++) {
-					float *localbox = &box[c * 7];
-					float image_id = localbox[0];
-					float label = localbox[1] - 1;
-					float confidence = localbox[2];
-
-					int labelnum = (int)label;
-					if ((confidence > conf_thresholdValue) && usedLabels[labelnum] &&
-					(prevVideoCap->label == labelnum)) {
-						prevVideoCap->currentCount++;
-						float xmin = localbox[3] * prevVideoCap->inputWidth;
-						float ymin = localbox[4] * prevVideoCap->inputHeight;
-						float xmax = localbox[5] * prevVideoCap->inputWidth;
-						float ymax = localbox[6] * prevVideoCap->inputHeight;
-						rectangle(prev_frame, Point((int)xmin, (int)ymin), Point((int)xmax, (int)ymax),
-							Scalar(0, 255, 0), 4, LINE_AA, 0);
-					}
+				{
+					TRACE_SCOPE("count", prevStream, prevFrameNo);
+					prevVideoCap->currentCount = countDetections(detections, usedLabels, prevVideoCap->label,
+						prev_frame, prevVideoCap->inputWidth, prevVideoCap->inputHeight);
+				}
+
+				if (prevVideoCap->live)
+				{
+					std::chrono::duration<double, std::milli> latency = std::chrono::steady_clock::now() - prevFrameTime;
+					prevVideoCap->latency = latency.count();
+					prevVideoCap->latencySum += prevVideoCap->latency;
+					prevVideoCap->latencyMax = std::max(prevVideoCap->latencyMax, prevVideoCap->latency);
+					prevVideoCap->latencyFrames++;
 				}
 
-				if (prevVideoCap->candidateCount == prevVideoCap->currentCount)
-					prevVideoCap->candidateConfidence++;
-				else {
-					prevVideoCap->candidateConfidence = 0;
-					prevVideoCap->candidateCount = prevVideoCap->currentCount;
+				if (updateResolution(*prevVideoCap, *backend, idleMs))
+				{
+					tm countTime = getCountTime(*prevVideoCap);
+					char str[64];
+					snprintf(str, sizeof(str), "%02d:%02d:%02d - %s input %dx%d", countTime.tm_hour, countTime.tm_min,
+						countTime.tm_sec, prevVideoCap->camName.c_str(), prevVideoCap->networkInput.width,
+						prevVideoCap->networkInput.height);
+					cout << str << endl;
+#ifndef UI_OUTPUT
+					logList.add(str);
+#endif
 				}
-				if (prevVideoCap->candidateConfidence == conf_candidateConfidence) {
-					prevVideoCap->candidateConfidence = 0;
+
+				if (confirmCount(prevVideoCap->currentCount, prevVideoCap->candidateCount,
+					prevVideoCap->candidateConfidence, conf_candidateConfidence)) {
 					prevVideoCap->changedCount = true;
 
 #ifdef UI_OUTPUT
@@ -729,10 +1563,12 @@ int main(int argc, char **argv)
 					if (prevVideoCap->currentCount > prevVideoCap->lastCorrectCount) {
 						prevVideoCap->totalCount += prevVideoCap->currentCount - prevVideoCap->lastCorrectCount;
 					}
+					prevVideoCap->aggregator.update(getStreamSeconds(*prevVideoCap), prevVideoCap->currentCount,
+						prevVideoCap->totalCount);
 
 					if (prevVideoCap->currentCount != prevVideoCap->lastCorrectCount) {
-						time_t t = time(nullptr);
-						tm *currTime = localtime(&t);
+						tm countTime = getCountTime(*prevVideoCap);
+						tm *currTime = &countTime;
 #ifdef UI_OUTPUT
 						frameInfo fr;
 						fr.frameNo = frames;
@@ -743,16 +1579,12 @@ int main(int argc, char **argv)
 #else
 						prevVideoCap->countAtFrame.emplace_back(prevVideoCap->frames, prevVideoCap->currentCount);
 						int detObj = prevVideoCap->currentCount - prevVideoCap->lastCorrectCount;
-						char str[50];
+						char str[64];
 						for (int j = 0; j < detObj; ++j) {
-							sprintf(str, "%02d:%02d:%02d - %s detected on %s", currTime->tm_hour,
+							snprintf(str, sizeof(str), "%02d:%02d:%02d - %s detected on %s", currTime->tm_hour,
 								currTime->tm_min, currTime->tm_sec, prevVideoCap->labelName.c_str(),
 								prevVideoCap->camName.c_str());
-							logList.emplace_back(str);
-							sprintf(str, "%s\n", str);
-							if (logList.size() > rollingLogSize) {
-								logList.pop_front();
-							}
+							logList.add(str);
 						}
 #endif
 					}
@@ -762,10 +1594,40 @@ int main(int argc, char **argv)
 					prevVideoCap->frames++;
 #endif
 					prevVideoCap->lastCorrectCount = prevVideoCap->currentCount;
+
+					if (checkpointer)
+					{
+						TRACE_SCOPE("checkpoint", prevStream, prevFrameNo);
+						checkpointCounts(*prevVideoCap, prevStream, *checkpointer);
+					}
 				}
 
+				if (prevVideoCap->shm)
+				{
+					TRACE_SCOPE("publish", prevStream, prevFrameNo);
+					prevVideoCap->shm->publish(prev_frame, detections, prevVideoCap->lastCorrectCount,
+						prevVideoCap->totalCount);
+				}
 
-				resize(prev_frame, prev_frame, Size(output_width, output_height));
+				if (++processedFrames == allocWarmupFrames)
+				{
+					warmAllocCount = allocStatsCount();
+					warmAllocBytes = allocStatsBytes();
+				}
+
+				if (replayMode)
+				{
+					++index;
+					continue;
+				}
+
+				// Scale into the preallocated display buffer of the video
+				Mat &display = prevVideoCap->display;
+				if (!prevVideoCap->headless)
+				{
+					TRACE_SCOPE("display resize", prevStream, prevFrameNo);
+					resize(prev_frame, display, Size(output_width, output_height));
+				}
 				//-------------------------------------------
 				//  Display the vidCapObj result and log window
 				//-------------------------------------------
@@ -779,63 +1641,80 @@ int main(int argc, char **argv)
 				imgName += '_' + to_string(prevVideoCap->frames);
 				frameNames.emplace_back(imgName);
 				imgName = conf_videoDir + imgName + ".jpg";
-				imwrite(imgName, prev_frame);
+				{
+					TRACE_SCOPE("imwrite", prevStream, prevFrameNo);
+					imwrite(imgName, display);
+				}
 
 				int a;
-				if (a = saveJSON(vidCaps, frameNames)) // Save JSONs for Live UI
+				{
+					TRACE_SCOPE("saveJSON", prevStream, prevFrameNo);
+					a = saveJSON(vidCaps, frameNames); // Save JSONs for Live UI
+					writeSummary(vidCaps);
+				}
+				if (a)
 				{
 					return a;
 				}
 #else
-				prevVideoCap->vw.write(prev_frame);
-
-				/* Add log text to each frame */
-				std::ostringstream s;
-				s << "Total " << prevVideoCap->labelName << " count: " << prevVideoCap->totalCount;
-				cv::putText(prev_frame, s.str(), cv::Point(10, output_height - 10),	FONT_HERSHEY_SIMPLEX,
-					0.5, cv::Scalar(255, 255, 255), 1, 8, false);
-				s.str("");
-				s.clear();
-				s << "Current " << prevVideoCap->labelName	<< " count: " << prevVideoCap->lastCorrectCount;
-				cv::putText(prev_frame, s.str(), cv::Point(10, output_height - 30),	FONT_HERSHEY_SIMPLEX,
-					0.5, cv::Scalar(255, 255, 255), 1, 8, false);
-
-				// Get app FPS
-				prevVideoCap->t2 = std::chrono::high_resolution_clock::now();
-				std::chrono::duration<float> time_span = std::chrono::duration_cast<std::chrono::duration<float>>(
-					prevVideoCap->t2 - prevVideoCap->t1);
-				char vid_fps[20];
-				sprintf(vid_fps, "FPS: %.2f", 1 / time_span.count());
-				cv::putText(prev_frame, string(vid_fps), cv::Point(10, output_height - 50),
-					FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 1, 8, false);
-
-				// Print infer time
-				char infTm[100];
-				if (!isAsyncMode) {
-					sprintf(infTm, "Infer time: %.3f", infer_time.count());
-				} else {
-					sprintf(infTm, "Infer time: N/A for Async mode");
-				}
-				cv::putText(prev_frame, string(infTm), cv::Point(10, output_height - 70),
-					FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 1, 8, false);
+				// The synthetic sources are neither shown nor recorded
+				if (!prevVideoCap->headless)
+				{
+					{
+						TRACE_SCOPE("video write", prevStream, prevFrameNo);
+						prevVideoCap->vw.write(display);
+					}
 
-				// Show current frame and update statistics window
-				cv::imshow(prevVideoCap->camName, prev_frame);
+					/* Add log text to each frame */
+					// Get app FPS
+					prevVideoCap->t2 = std::chrono::high_resolution_clock::now();
+					std::chrono::duration<float> time_span = std::chrono::duration_cast<std::chrono::duration<float>>(
+						prevVideoCap->t2 - prevVideoCap->t1);
+					{
+						TRACE_SCOPE("overlay", prevStream, prevFrameNo);
+						drawOverlay(display, prevVideoCap->overlayText, prevVideoCap->labelName, prevVideoCap->totalCount,
+							prevVideoCap->lastCorrectCount, 1 / time_span.count(), isAsyncMode ? -1 : infer_time.count());
+						int line = output_height - 90;
+						char text[100];
+						if (prevVideoCap->live)
+						{
+							snprintf(text, sizeof(text), "Latency: %.0f ms", prevVideoCap->latency);
+							prevVideoCap->overlayText.assign(text);
+							cv::putText(display, prevVideoCap->overlayText, cv::Point(10, line),
+								FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 1, 8, false);
+							line -= 20;
+						}
+						if (prevVideoCap->resolution.variants() > 1)
+						{
+							snprintf(text, sizeof(text), "Input: %dx%d", prevVideoCap->networkInput.width,
+								prevVideoCap->networkInput.height);
+							prevVideoCap->overlayText.assign(text);
+							cv::putText(display, prevVideoCap->overlayText, cv::Point(10, line),
+								FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 1, 8, false);
+						}
+					}
 
-				prevVideoCap->t1 = std::chrono::high_resolution_clock::now();
+					// Show current frame and update statistics window
+					{
+						TRACE_SCOPE("imshow", prevStream, prevFrameNo);
+						cv::imshow(prevVideoCap->camName, display);
+					}
+				}
 
-				stats =	Mat(output_height > (vidCaps.size() * 20 + 15) ? output_height :
-					(vidCaps.size() * 20 + 15),	output_width > 345 ? output_width : 345, CV_8UC1, Scalar(0));
+				prevVideoCap->t1 = std::chrono::high_resolution_clock::now();
 
-				int i = 0;
-				for (list<string>::iterator it = logList.begin(); it != logList.end(); ++it)
+				if (showWindows)
 				{
-					putText(stats, *it, Point(10, 15 + 20 * i), FONT_HERSHEY_SIMPLEX, 0.5,
-						Scalar(255, 255, 255), 1, 8, false);
-					++i;
-				}
+					TRACE_SCOPE("statistics");
+					stats.setTo(Scalar(0));
+					for (size_t i = 0; i < logList.size(); ++i)
+					{
+						putText(stats, logList[i], Point(10, 15 + 20 * i), FONT_HERSHEY_SIMPLEX, 0.5,
+							Scalar(255, 255, 255), 1, 8, false);
+					}
 
-				cv::imshow("Statistics", stats);
+					cv::imshow("Statistics", stats);
+				}
 
 				/**
 				* Show frame as soon as possible and exit if ESC key is
@@ -846,24 +1725,41 @@ int main(int argc, char **argv)
 				processing is faster
 				* than input
 				* the application will wait for next frame on capture.
-				* You can use vidCaps[0].vc.get(cv::CAP_PROP_FPS) to use
+				* You can use vidCaps[0].vc->get(cv::CAP_PROP_FPS) to use
 				the FPS of
 				* the 1st vidCapObj.
 				*/
-				if (waitKey(1) == 27) {
+				if (std::chrono::steady_clock::now() - lastSummary > std::chrono::seconds(conf_summaryInterval))
+				{
+					AllocStatsPause pause;
+					writeSummary(vidCaps);
+					lastSummary = std::chrono::steady_clock::now();
+				}
+
+				int key = -1;
+				if (showWindows)
+				{
+					TRACE_SCOPE("waitKey");
+					key = waitKey(1);
+				}
+				if (key == 27) {
+					finishTrace();
 					saveJSON(vidCaps);
+					writeSummary(vidCaps);
 					delete[] output_frames;
+					reportAllocStats(processedFrames - allocWarmupFrames, warmAllocCount, warmAllocBytes);
+					reportLatency(vidCaps);
 					cout << "Finished\n";
 					return 0;
 				}
 #endif
 				if (loopVideos && !vidCapObj.isCam)
 				{
-					int vfps = (int)round(vidCapObj.vc.get(CAP_PROP_FPS));
-					if (vidCapObj.loopFrames > vidCapObj.vc.get(CAP_PROP_FRAME_COUNT) - round(vfps / minFPS))
+					int vfps = (int)round(vidCapObj.vc->get(CAP_PROP_FPS));
+					if (vidCapObj.loopFrames > vidCapObj.vc->get(CAP_PROP_FRAME_COUNT) - round(vfps / minFPS))
 					{
 						vidCapObj.loopFrames = 0;
-						vidCapObj.vc.set(CAP_PROP_POS_FRAMES, 0);
+						vidCapObj.vc->set(CAP_PROP_POS_FRAMES, 0);
 					}
 
 				}
@@ -872,8 +1768,12 @@ int main(int argc, char **argv)
 			++index;
 			if (isAsyncMode)
 			{
-				currInfReq.swap(nextInfReq);
-				prev_frame = vidCapObj.frame.clone();
+				std::swap(currReq, nextReq);
+				// No copy needed: the frame buffer is not reused by the frame pool
+				// until prev_frame lets go of it
+				prev_frame = vidCapObj.frame;
+				prevFrameTime = vidCapObj.frameTime;
+				model.prevFrameNo = vidCapObj.loopFrames;
 				prevVideoCap = &vidCapObj;
 			}
 
@@ -882,8 +1782,46 @@ int main(int argc, char **argv)
 		// Check if all the videos have ended
 		if (find(noMoreData.begin(), noMoreData.end(), false) == noMoreData.end())
 			break;
+
+		if (conf_traceDuration > 0 && traceActive && std::chrono::steady_clock::now() > traceEnd)
+		{
+			finishTrace();
+		}
+
+		// Only lost cameras are left: wait for them without spinning
+		if (!submitted)
+		{
+			std::chrono::steady_clock::time_point waitStart = std::chrono::steady_clock::now();
+#ifdef UI_OUTPUT
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+#else
+			if (showWindows)
+				waitKey(10);
+			else
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+#endif
+			idleMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+		}
 	}
 	delete[] output_frames;
+	finishTrace();
+	reportAllocStats(processedFrames - allocWarmupFrames, warmAllocCount, warmAllocBytes);
+	reportLatency(vidCaps);
+	writeSummary(vidCaps);
+
+	if (replayMode)
+	{
+		json replay;
+		int a;
+		if ((a = saveReplay(vidCaps, &replay)) != 0)
+		{
+			return a;
+		}
+		if (!conf_goldenFile.empty())
+		{
+			return compareGolden(replay);
+		}
+	}
 	cout << "Finished\n";
 	return 0;
 }
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include <output_decoder.hpp>
+
+// YOLO networks output many overlapping boxes for each object
+static const float nmsOverlap = 0.45f;
+
+// SSD DetectionOutput. Every proposal is image_id, label, confidence, xmin, ymin,
+// xmax, ymax, and the proposals of the image are followed by one with image_id -1,
+// after which the output holds no data.
+class SSDFormat {
+public:
+	SSDFormat(int maxProposalCount)
+		: maxProposalCount(maxProposalCount) {}
+
+	static const char *name()
+	{
+		return "ssd";
+	}
+
+	void decode(const float *output, float threshold, std::vector<Detection> &detections)
+	{
+		// Collect the indices above the threshold without a branch per proposal,
+		// then read only those
+		candidates.resize(maxProposalCount);
+		int count = 0;
+		for (int c = 0; c < maxProposalCount; c++) {
+			const float *box = &output[c * 7];
+			if (box[0] < 0)
+				break;
+			candidates[count] = c;
+			count += box[2] > threshold;
+		}
+
+		detections.clear();
+		for (int i = 0; i < count; i++) {
+			const float *box = &output[candidates[i] * 7];
+			Detection d;
+			d.label = (int)(box[1] - 1);
+			d.confidence = box[2];
+			d.xmin = box[3];
+			d.ymin = box[4];
+			d.xmax = box[5];
+			d.ymax = box[6];
+			detections.push_back(d);
+		}
+	}
+
+private:
+	int maxProposalCount;
+	std::vector<int> candidates;
+};
+
+// Keep the most confident of the boxes of a class that overlap
+static void suppressOverlaps(std::vector<Detection> &detections)
+{
+	std::sort(detections.begin(), detections.end(), [](const Detection &a, const Detection &b) {
+		return a.confidence > b.confidence;
+	});
+	size_t kept = 0;
+	for (size_t i = 0; i < detections.size(); ++i)
+	{
+		const Detection &d = detections[i];
+		bool overlaps = false;
+		for (size_t k = 0; k < kept && !overlaps; ++k)
+		{
+			const Detection &o = detections[k];
+			if (o.label != d.label)
+				continue;
+			float w = std::min(d.xmax, o.xmax) - std::max(d.xmin, o.xmin);
+			float h = std::min(d.ymax, o.ymax) - std::max(d.ymin, o.ymin);
+			if (w <= 0 || h <= 0)
+				continue;
+			float intersection = w * h;
+			float areas = (d.xmax - d.xmin) * (d.ymax - d.ymin) + (o.xmax - o.xmin) * (o.ymax - o.ymin);
+			overlaps = intersection > nmsOverlap * (areas - intersection);
+		}
+		if (!overlaps)
+			detections[kept++] = d;
+	}
+	detections.resize(kept);
+}
+
+static Detection yoloBox(int label, float confidence, float cx, float cy, float w, float h,
+	float scaleX, float scaleY)
+{
+	Detection d;
+	d.label = label;
+	d.confidence = confidence;
+	d.xmin = (cx - w / 2) * scaleX;
+	d.ymin = (cy - h / 2) * scaleY;
+	d.xmax = (cx + w / 2) * scaleX;
+	d.ymax = (cy + h / 2) * scaleY;
+	return d;
+}
+
+// YOLO with objectness: for every box cx, cy, w, h, objectness, then the class
+// scores. Most boxes are rejected on their objectness alone.
+class YoloFormat {
+public:
+	YoloFormat(size_t boxes, size_t classes, size_t inputWidth, size_t inputHeight)
+		: boxes(boxes)
+		, classes(classes)
+		, scaleX(1.0f / inputWidth)
+		, scaleY(1.0f / inputHeight) {}
+
+	static const char *name()
+	{
+		return "yolo";
+	}
+
+	void decode(const float *output, float threshold, std::vector<Detection> &detections)
+	{
+		detections.clear();
+		const size_t stride = 5 + classes;
+		for (size_t i = 0; i < boxes; ++i) {
+			const float *box = &output[i * stride];
+			if (box[4] <= threshold)
+				continue;
+			const float *scores = box + 5;
+			size_t best = std::max_element(scores, scores + classes) - scores;
+			float confidence = box[4] * scores[best];
+			if (confidence > threshold)
+				detections.push_back(yoloBox((int)best, confidence, box[0], box[1], box[2], box[3], scaleX, scaleY));
+		}
+		suppressOverlaps(detections);
+	}
+
+private:
+	size_t boxes;
+	size_t classes;
+	float scaleX;
+	float scaleY;
+};
+
+// Anchor-free YOLO, transposed: the output holds rows of N values, cx, cy, w, h,
+// then the score of every class. The best class of every box is found one class
+// row at a time, a loop over contiguous floats that the compiler vectorizes.
+class AnchorFreeYoloFormat {
+public:
+	AnchorFreeYoloFormat(size_t boxes, size_t classes, size_t inputWidth, size_t inputHeight)
+		: boxes(boxes)
+		, classes(classes)
+		, scaleX(1.0f / inputWidth)
+		, scaleY(1.0f / inputHeight)
+		, bestScore(boxes)
+		, bestClass(boxes) {}
+
+	static const char *name()
+	{
+		return "yolo-anchor-free";
+	}
+
+	void decode(const float *output, float threshold, std::vector<Detection> &detections)
+	{
+		const float *scores = output + 4 * boxes;
+		float *score = bestScore.data();
+		int *label = bestClass.data();
+		std::copy(scores, scores + boxes, score);
+		std::fill(label, label + boxes, 0);
+		for (size_t c = 1; c < classes; ++c) {
+			const float *row = scores + c * boxes;
+			for (size_t i = 0; i < boxes; ++i) {
+				bool better = row[i] > score[i];
+				score[i] = better ? row[i] : score[i];
+				label[i] = better ? (int)c : label[i];
+			}
+		}
+
+		detections.clear();
+		for (size_t i = 0; i < boxes; ++i) {
+			if (score[i] > threshold)
+				detections.push_back(yoloBox(label[i], score[i], output[i], output[boxes + i],
+					output[2 * boxes + i], output[3 * boxes + i], scaleX, scaleY));
+		}
+		suppressOverlaps(detections);
+	}
+
+private:
+	size_t boxes;
+	size_t classes;
+	float scaleX;
+	float scaleY;
+	std::vector<float> bestScore;
+	std::vector<int> bestClass;
+};
+
+template <typename Format>
+class Decoder : public OutputDecoder {
+public:
+	Decoder(const Format &format)
+		: format(format) {}
+
+	const char *name() const
+	{
+		return Format::name();
+	}
+
+	void decode(const float *output, float threshold, std::vector<Detection> &detections)
+	{
+		format.decode(output, threshold, detections);
+	}
+
+private:
+	Format format;
+};
+
+template <typename Format>
+static std::unique_ptr<OutputDecoder> makeDecoder(const Format &format)
+{
+	return std::unique_ptr<OutputDecoder>(new Decoder<Format>(format));
+}
+
+std::unique_ptr<OutputDecoder> createDecoder(const std::vector<size_t> &dims, size_t inputWidth, size_t inputHeight)
+{
+	if (dims.size() == 4 && dims[0] == 1 && dims[1] == 1 && dims[3] == 7)
+	{
+		return makeDecoder(SSDFormat((int)dims[2]));
+	}
+	if (dims.size() == 3 && dims[0] == 1 && dims[1] > dims[2] && dims[2] > 5)
+	{
+		return makeDecoder(YoloFormat(dims[1], dims[2] - 5, inputWidth, inputHeight));
+	}
+	if (dims.size() == 3 && dims[0] == 1 && dims[2] > dims[1] && dims[1] > 4)
+	{
+		return makeDecoder(AnchorFreeYoloFormat(dims[2], dims[1] - 4, inputWidth, inputHeight));
+	}
+
+	std::string shape;
+	for (size_t d : dims)
+	{
+		shape += (shape.empty() ? "" : ", ") + std::to_string(d);
+	}
+	throw std::logic_error("Unsupported output shape [" + shape + "], expected SSD [1, 1, N, 7] or "
+		"YOLO [1, N, 5 + classes] or [1, 4 + classes, N]");
+}
@@ -0,0 +1,369 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <daemon_protocol.hpp>
+#include <inference_backend.hpp>
+
+// Backend running the inferences in the inference daemon, which loads the model
+// once for all the processes of the host. The frames go through the shared memory
+// given by the daemon and only the small messages of the protocol through the socket.
+// When the daemon goes away, the requests in flight fail and the following submits
+// try to connect again, less and less often, until the daemon is back.
+class RemoteBackend : public InferenceBackend {
+public:
+	RemoteBackend(const BackendConfig &config)
+		: socketPath(config.socket)
+		, requests(config.requests)
+		, threshold(config.threshold)
+		, fd(-1)
+		, mem(nullptr)
+		, memSize(0)
+		, welcome()
+		, receiving(false)
+		, connected(false)
+		, generation(0)
+		, backoff(minBackoff)
+	{
+		std::string error;
+		if (!connectDaemon(welcome, error))
+		{
+			throw std::logic_error(error);
+		}
+		connected = true;
+		slots.resize(welcome.requests);
+		snprintf(backendName, sizeof(backendName), "remote %.15s", welcome.backend);
+	}
+
+	~RemoteBackend()
+	{
+		close();
+	}
+
+	const char *name() const
+	{
+		return backendName;
+	}
+
+	size_t inputWidth() const
+	{
+		return welcome.inputWidth;
+	}
+
+	size_t inputHeight() const
+	{
+		return welcome.inputHeight;
+	}
+
+	size_t requestCount() const
+	{
+		return slots.size();
+	}
+
+	void submit(size_t request, const cv::Mat &frame)
+	{
+		if (frame.cols != (int)welcome.inputWidth || frame.rows != (int)welcome.inputHeight ||
+			frame.type() != CV_8UC3)
+		{
+			throw std::logic_error("The frames sent to the inference daemon must have the network input size");
+		}
+
+		// The shared memory is replaced when connecting again, so the frame is
+		// copied under the lock
+		std::unique_lock<std::mutex> lock(mutex);
+		Slot &slot = slots[request];
+		slot.pending = true;
+		slot.done = false;
+		slot.generation = generation;
+		if (!connected && !reconnect(lock))
+		{
+			return;
+		}
+		slot.generation = generation;
+		uint8_t *pixels = mem + request * welcome.slotSize;
+		size_t rowSize = frame.cols * 3;
+		for (int y = 0; y < frame.rows; ++y)
+		{
+			memcpy(pixels + y * rowSize, frame.ptr(y), rowSize);
+		}
+		DaemonSubmit submit = {(uint32_t)request};
+		if (!daemonSend(fd, &submit, sizeof(submit)))
+		{
+			disconnect();
+		}
+	}
+
+	// Returns false if the connection was lost or the inference failed in the daemon
+	bool wait(size_t request, std::vector<Detection> &detections)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		Slot &slot = slots[request];
+		if (!slot.pending)
+		{
+			return false;
+		}
+		// The results come in completion order. The first waiting thread reads them
+		// from the socket for every request, the others wait for it. A request sent
+		// on a previous connection has no result to wait for
+		while (!slot.done && connected && slot.generation == generation)
+		{
+			if (receiving)
+			{
+				received.wait(lock);
+				continue;
+			}
+			receiving = true;
+			lock.unlock();
+			bool ok = receiveResult();
+			lock.lock();
+			receiving = false;
+			if (!ok && connected)
+			{
+				disconnect();
+			}
+			received.notify_all();
+		}
+		slot.pending = false;
+		if (!slot.done || slot.status != 0)
+		{
+			return false;
+		}
+		detections.swap(slot.detections);
+		return true;
+	}
+
+private:
+	struct Slot {
+		bool pending = false;
+		bool done = false;
+		int status = 0;
+		unsigned generation = 0;    // Connection the request was sent on
+		std::vector<Detection> detections;
+	};
+
+	static const std::chrono::milliseconds minBackoff;
+	static const std::chrono::milliseconds maxBackoff;
+
+	// Connect to the daemon and map its shared memory. A new connection must
+	// match the input size and the requests of the first one
+	bool connectDaemon(DaemonWelcome &answer, std::string &error)
+	{
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+		if (fd < 0 || connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0)
+		{
+			close();
+			error = "Could not connect to the inference daemon at " + socketPath;
+			return false;
+		}
+
+		DaemonHello hello = {daemonMagic, daemonVersion, (uint32_t)requests, threshold};
+		int memFd = -1;
+		if (!daemonSend(fd, &hello, sizeof(hello)) || !receiveWelcome(answer, memFd))
+		{
+			close();
+			error = "No answer from the inference daemon at " + socketPath;
+			return false;
+		}
+		bool changed = !slots.empty() && (answer.requests != welcome.requests ||
+			answer.inputWidth != welcome.inputWidth || answer.inputHeight != welcome.inputHeight);
+		if (answer.magic != daemonMagic || answer.version != daemonVersion || answer.status != 0 || memFd < 0 ||
+			changed)
+		{
+			if (memFd >= 0)
+			{
+				::close(memFd);
+			}
+			close();
+			error = changed ? "The inference daemon at " + socketPath + " now has another input size or number of requests" :
+				"The inference daemon at " + socketPath + " refused the connection";
+			return false;
+		}
+		memSize = answer.slotSize * answer.requests;
+		void *m = mmap(nullptr, memSize, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+		::close(memFd);
+		if (m == MAP_FAILED)
+		{
+			close();
+			error = "Could not map the shared memory of the inference daemon";
+			return false;
+		}
+		mem = static_cast<uint8_t *>(m);
+		return true;
+	}
+
+	// Called with the mutex held. The thread reading the socket, if any, sees the
+	// connection closed and returns
+	void disconnect()
+	{
+		std::cout << "Lost the connection to the inference daemon at " << socketPath << std::endl;
+		connected = false;
+		shutdown(fd, SHUT_RDWR);
+		nextAttempt = std::chrono::steady_clock::now();
+		backoff = minBackoff;
+	}
+
+	// Called with the mutex held, by submit. The attempts are spaced by a delay
+	// that doubles after each failure
+	bool reconnect(std::unique_lock<std::mutex> &lock)
+	{
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now < nextAttempt)
+		{
+			return false;
+		}
+		received.wait(lock, [this]() { return !receiving; });
+		close();
+		// The input size and the requests are read without the lock and do not
+		// change, only the slot size is taken from the new connection
+		DaemonWelcome answer;
+		std::string error;
+		if (!connectDaemon(answer, error))
+		{
+			if (backoff == minBackoff)
+			{
+				std::cout << error << ", retrying" << std::endl;
+			}
+			nextAttempt = now + backoff;
+			backoff = std::min(backoff * 2, maxBackoff);
+			return false;
+		}
+		welcome.slotSize = answer.slotSize;
+		connected = true;
+		++generation;
+		std::cout << "Reconnected to the inference daemon at " << socketPath << std::endl;
+		return true;
+	}
+
+	void close()
+	{
+		if (mem)
+		{
+			munmap(mem, memSize);
+			mem = nullptr;
+		}
+		if (fd >= 0)
+		{
+			::close(fd);
+			fd = -1;
+		}
+	}
+
+	bool receiveWelcome(DaemonWelcome &answer, int &memFd)
+	{
+		char control[CMSG_SPACE(sizeof(int))];
+		struct iovec iov = {&answer, sizeof(answer)};
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+		if (n <= 0)
+		{
+			return false;
+		}
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+		{
+			memcpy(&memFd, CMSG_DATA(cmsg), sizeof(int));
+		}
+		// The descriptor comes with the first byte, the rest may follow separately
+		return daemonReceive(fd, reinterpret_cast<char *>(&answer) + n, sizeof(answer) - n);
+	}
+
+	// Read one result from the socket into its slot, without holding the mutex
+	bool receiveResult()
+	{
+		DaemonResult result;
+		if (!daemonReceive(fd, &result, sizeof(result)) || result.request >= slots.size())
+		{
+			return false;
+		}
+		incoming.resize(result.numDetections);
+		if (!daemonReceive(fd, incoming.data(), incoming.size() * sizeof(DaemonDetection)))
+		{
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		Slot &slot = slots[result.request];
+		slot.detections.clear();
+		for (const DaemonDetection &in : incoming)
+		{
+			Detection d;
+			d.label = in.label;
+			d.confidence = in.confidence;
+			d.xmin = in.xmin;
+			d.ymin = in.ymin;
+			d.xmax = in.xmax;
+			d.ymax = in.ymax;
+			slot.detections.push_back(d);
+		}
+		slot.status = result.status;
+		slot.done = true;
+		return true;
+	}
+
+	std::string socketPath;
+	size_t requests;
+	float threshold;
+	int fd;
+	uint8_t *mem;
+	size_t memSize;
+	DaemonWelcome welcome;
+	char backendName[32];
+	std::vector<Slot> slots;
+	std::vector<DaemonDetection> incoming;  // Only used by the receiving thread
+	std::mutex mutex;
+	std::condition_variable received;
+	bool receiving;
+	bool connected;
+	unsigned generation;    // Incremented on every new connection
+	std::chrono::steady_clock::time_point nextAttempt;
+	std::chrono::milliseconds backoff;
+};
+
+const std::chrono::milliseconds RemoteBackend::minBackoff(100);
+const std::chrono::milliseconds RemoteBackend::maxBackoff(5000);
+
+std::unique_ptr<InferenceBackend> createRemoteBackend(const BackendConfig &config)
+{
+	return std::unique_ptr<InferenceBackend>(new RemoteBackend(config));
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <algorithm>
+
+#include <resolution_controller.hpp>
+
+static const long warmupFrames = 30;    // The first frames are slow while the buffers grow
+static const double smoothing = 0.1;
+static const double downLoad = 1.0;
+static const double upLoad = 0.8;
+static const double holdMs = 2000;
+
+ResolutionController::ResolutionController(const std::vector<double> &cost, double frameMs)
+	: cost(cost)
+	, frameMs(frameMs)
+	, holdFrames(std::max(1L, (long)(holdMs / frameMs)))
+{
+}
+
+bool ResolutionController::update(double busyMs, double latencyMs)
+{
+	if (cost.size() < 2 || ++frames <= warmupFrames)
+	{
+		return false;
+	}
+	// In async mode a frame is counted one frame of the pipeline after it was read
+	double load = std::max(busyMs, latencyMs / 2) / frameMs;
+	smoothed = frames == warmupFrames + 1 ? load : smoothed + smoothing * (load - smoothed);
+	if (++framesSinceSwitch < holdFrames)
+	{
+		return false;
+	}
+
+	size_t next = current;
+	if (smoothed > downLoad && current + 1 < cost.size())
+	{
+		next = current + 1;
+	}
+	else if (current > 0 && smoothed * cost[current - 1] / cost[current] < upLoad)
+	{
+		next = current - 1;
+	}
+	if (next == current)
+	{
+		return false;
+	}
+	// Start from the load expected on the new variant rather than wait for it
+	smoothed = smoothed * cost[next] / cost[current];
+	current = next;
+	framesSinceSwitch = 0;
+	++switchCount;
+	return true;
+}
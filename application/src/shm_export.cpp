@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <shm_export.hpp>
+
+static size_t alignUp(size_t size, size_t alignment)
+{
+	return (size + alignment - 1) / alignment * alignment;
+}
+
+// Whether an existing object was left by a writer that is no longer running. An
+// object whose header is not complete yet may be in use, so it is not stale
+static bool isStale(const std::string &name)
+{
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+	{
+		return errno == ENOENT;
+	}
+	struct stat st;
+	void *mem = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(ShmHeader))
+	{
+		mem = mmap(nullptr, sizeof(ShmHeader), PROT_READ, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (mem == MAP_FAILED)
+	{
+		return false;
+	}
+	const ShmHeader *header = static_cast<const ShmHeader *>(mem);
+	bool stale = header->magic == shmMagic && header->ownerPid > 0 &&
+		kill(header->ownerPid, 0) != 0 && errno == ESRCH;
+	munmap(mem, sizeof(ShmHeader));
+	return stale;
+}
+
+ShmExporter::ShmExporter(const std::string &name, const std::string &camName, const std::string &labelName,
+                         int label, int slotCount)
+	: shmName(name)
+	, camName(camName)
+	, labelName(labelName)
+	, label(label)
+	, slotCount(slotCount)
+	, failed(false)
+	, header(nullptr)
+	, size(0)
+	, frames(0) {}
+
+ShmExporter::~ShmExporter()
+{
+	if (header)
+	{
+		munmap(header, size);
+		shm_unlink(shmName.c_str());
+	}
+}
+
+bool ShmExporter::create(int width, int height)
+{
+	size_t headerSize = alignUp(sizeof(ShmHeader), 64);
+	size_t pixelOffset = alignUp(sizeof(ShmSlot), 64);
+	size_t slotSize = alignUp(pixelOffset + (size_t)width * height * 3, 64);
+	size = headerSize + slotSize * slotCount;
+
+	int fd = shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0 && errno == EEXIST && isStale(shmName))
+	{
+		// Left by a previous run that did not remove it
+		shm_unlink(shmName.c_str());
+		fd = shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	}
+	if (fd < 0 && errno == EEXIST)
+	{
+		std::cout << "Shared memory " << shmName << " is used by another running instance, "
+			<< "remove /dev/shm" << shmName << " if it is not" << std::endl;
+		return false;
+	}
+	if (fd < 0)
+	{
+		std::cout << "Could not create shared memory " << shmName << std::endl;
+		return false;
+	}
+	if (ftruncate(fd, size) != 0)
+	{
+		std::cout << "Could not allocate shared memory " << shmName << std::endl;
+		close(fd);
+		shm_unlink(shmName.c_str());
+		return false;
+	}
+	void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED)
+	{
+		std::cout << "Could not map shared memory " << shmName << std::endl;
+		shm_unlink(shmName.c_str());
+		return false;
+	}
+
+	// ftruncate zero-fills the object, which is a valid initial state for the atomics
+	header = static_cast<ShmHeader *>(mem);
+	header->version = shmVersion;
+	header->slotCount = slotCount;
+	header->headerSize = headerSize;
+	header->slotSize = slotSize;
+	header->pixelOffset = pixelOffset;
+	header->maxWidth = width;
+	header->maxHeight = height;
+	header->label = label;
+	header->ownerPid = getpid();
+	strncpy(header->labelName, labelName.c_str(), shmNameLength - 1);
+	strncpy(header->camName, camName.c_str(), shmNameLength - 1);
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic = shmMagic;
+	return true;
+}
+
+void ShmExporter::publish(const cv::Mat &frame, const std::vector<Detection> &detections,
+                          int currentCount, int totalCount)
+{
+	if (!header)
+	{
+		if (failed)
+		{
+			return;
+		}
+		if (!create(frame.cols, frame.rows))
+		{
+			failed = true;
+			return;
+		}
+	}
+
+	uint64_t n = ++frames;
+	ShmSlot *slot = shmSlot(header, n);
+	slot->seq.store(2 * n - 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot->timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+	slot->currentCount = currentCount;
+	slot->totalCount = totalCount;
+	int numDetections = 0;
+	for (const Detection &d : detections)
+	{
+		if (d.label != label || numDetections == shmMaxDetections)
+		{
+			continue;
+		}
+		ShmDetection &out = slot->detections[numDetections++];
+		out.confidence = d.confidence;
+		out.xmin = d.xmin;
+		out.ymin = d.ymin;
+		out.xmax = d.xmax;
+		out.ymax = d.ymax;
+	}
+	slot->numDetections = numDetections;
+
+	if (frame.cols <= (int)header->maxWidth && frame.rows <= (int)header->maxHeight &&
+		frame.type() == CV_8UC3)
+	{
+		slot->width = frame.cols;
+		slot->height = frame.rows;
+		slot->step = frame.cols * 3;
+		uint8_t *pixels = shmPixels(header, slot);
+		for (int y = 0; y < frame.rows; ++y)
+		{
+			memcpy(pixels + y * slot->step, frame.ptr(y), slot->step);
+		}
+	}
+	else
+	{
+		slot->width = 0;
+		slot->height = 0;
+		slot->step = 0;
+	}
+
+	slot->seq.store(2 * n, std::memory_order_release);
+	header->latest.store(n, std::memory_order_release);
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Example consumer of the shared memory export. It maps the ring buffer of one
+// video read-only and prints the counts and detections of every new frame,
+// reading them in place without copying the pixels.
+//
+//   store-traffic-monitor-shm-reader /stm_Video_1 [FRAMES]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <shm_layout.hpp>
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s SHM_NAME [FRAMES]\n", argv[0]);
+		return 1;
+	}
+	long maxFrames = argc > 2 ? strtol(argv[2], nullptr, 10) : 0;
+
+	int fd = shm_open(argv[1], O_RDONLY, 0);
+	if (fd < 0)
+	{
+		printf("Could not open shared memory %s\n", argv[1]);
+		return 2;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ShmHeader))
+	{
+		printf("Shared memory %s is not ready\n", argv[1]);
+		return 2;
+	}
+	void *mem = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED)
+	{
+		printf("Could not map shared memory %s\n", argv[1]);
+		return 2;
+	}
+	ShmHeader *header = static_cast<ShmHeader *>(mem);
+	if (header->magic != shmMagic || header->version != shmVersion)
+	{
+		printf("%s is not a store-traffic-monitor export\n", argv[1]);
+		return 3;
+	}
+	printf("%s: %s, label %s, %u slots of %ux%u\n", argv[1], header->camName, header->labelName,
+		header->slotCount, header->maxWidth, header->maxHeight);
+
+	uint64_t last = 0;
+	long frames = 0;
+	long torn = 0;
+	while (maxFrames == 0 || frames < maxFrames)
+	{
+		uint64_t n = header->latest.load(std::memory_order_acquire);
+		if (n == last)
+		{
+			usleep(1000);
+			continue;
+		}
+		ShmSlot *slot = shmSlot(header, n);
+		if (slot->seq.load(std::memory_order_acquire) != 2 * n)
+		{
+			continue;
+		}
+
+		// Read the slot in place
+		int64_t timestampUs = slot->timestampUs;
+		int currentCount = slot->currentCount;
+		int totalCount = slot->totalCount;
+		int numDetections = slot->numDetections;
+		float firstConfidence = numDetections > 0 ? slot->detections[0].confidence : 0;
+		const uint8_t *pixels = shmPixels(header, slot);
+		unsigned long checksum = 0;
+		// A slot being overwritten may hold any size, so stay within the slot
+		int height = std::min(slot->height, (int32_t)header->maxHeight);
+		int step = std::min(slot->step, (int32_t)header->maxWidth * 3);
+		for (int y = 0; y < height; y += 16)
+		{
+			for (int x = 0; x < step; x += 48)
+			{
+				checksum += pixels[y * step + x];
+			}
+		}
+
+		// Discard the data if the writer reused the slot while it was being read
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot->seq.load(std::memory_order_relaxed) != 2 * n)
+		{
+			++torn;
+			continue;
+		}
+
+		if (last != 0 && n != last + 1)
+		{
+			printf("Skipped %lu frames\n", (unsigned long)(n - last - 1));
+		}
+		printf("frame %lu at %lld us: current %d, total %d, %d detections (first %.2f), pixel sum %lu\n",
+			(unsigned long)n, (long long)timestampUs, currentCount, totalCount, numDetections,
+			firstConfidence, checksum);
+		last = n;
+		++frames;
+	}
+	printf("%ld frames read, %ld discarded while being overwritten\n", frames, torn);
+
+	munmap(mem, st.st_size);
+	return 0;
+}
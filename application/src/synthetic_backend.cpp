@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include <nlohmann/json.hpp>
+#include "opencv2/imgproc.hpp"
+
+#include <inference_backend.hpp>
+#include <synthetic_source.hpp>
+
+using json = nlohmann::json;
+
+// Backend that does not run any network. It returns the detections of a script
+// after a fixed latency, so the cost of the rest of the pipeline can be measured
+// on its own. The script is a JSON array with one entry per inference, each entry
+// being an array of [label, confidence, xmin, ymin, xmax, ymax] detections. The
+// script is repeated when its end is reached. Without a script the objects drawn
+// by the synthetic video source are detected. A reshaped network has a latency
+// proportional to its number of input pixels.
+class SyntheticBackend : public InferenceBackend {
+public:
+	SyntheticBackend(const BackendConfig &config)
+		: width(scaledInputSize(config.inputWidth, config.scale))
+		, height(scaledInputSize(config.inputHeight, config.scale))
+		, latency((long)(config.latencyMs * 1000.0 * width * height / (config.inputWidth * config.inputHeight)))
+		, threshold(config.threshold)
+		, next(0)
+		, slots(config.requests)
+	{
+		if (!config.script.empty())
+		{
+			loadScript(config.script);
+		}
+	}
+
+	const char *name() const
+	{
+		return "synthetic";
+	}
+
+	size_t inputWidth() const
+	{
+		return width;
+	}
+
+	size_t inputHeight() const
+	{
+		return height;
+	}
+
+	size_t requestCount() const
+	{
+		return slots.size();
+	}
+
+	void submit(size_t request, const cv::Mat &frame)
+	{
+		Slot &slot = slots[request];
+		slot.started = true;
+		slot.ready = std::chrono::steady_clock::now() + latency;
+		if (script.empty())
+		{
+			detectSyntheticObjects(frame, slot);
+		}
+		else
+		{
+			slot.entry = next++ % script.size();
+		}
+	}
+
+	bool wait(size_t request, std::vector<Detection> &detections)
+	{
+		Slot &slot = slots[request];
+		if (!slot.started)
+		{
+			return false;
+		}
+		slot.started = false;
+		std::this_thread::sleep_until(slot.ready);
+
+		detections.clear();
+		if (script.empty())
+		{
+			detections.insert(detections.end(), slot.detections.begin(), slot.detections.end());
+		}
+		else
+		{
+			for (const Detection &d : script[slot.entry])
+			{
+				if (d.confidence > threshold)
+				{
+					detections.push_back(d);
+				}
+			}
+		}
+		return true;
+	}
+
+private:
+	struct Box {
+		int xmin, ymin, xmax, ymax;
+	};
+
+	struct Slot {
+		bool started = false;
+		std::chrono::steady_clock::time_point ready;
+		size_t entry = 0;
+		cv::Mat mask;
+		cv::Mat labels;
+		std::vector<int> parents;
+		std::vector<Box> boxes;
+		std::vector<Detection> detections;
+	};
+
+	static int findRoot(std::vector<int> &parents, int label)
+	{
+		while (parents[label] != label)
+		{
+			parents[label] = parents[parents[label]];
+			label = parents[label];
+		}
+		return label;
+	}
+
+	// Find the rectangles drawn by SyntheticCapture: their green channel is at
+	// syntheticObjectLevel and their blue channel holds the label + 1. Touching
+	// rectangles are merged into one detection, as the 8-connected components of
+	// the mask. The buffers of the slot are reused, so once warmed up no memory is
+	// allocated, unlike with cv::findContours
+	void detectSyntheticObjects(const cv::Mat &frame, Slot &slot)
+	{
+		slot.detections.clear();
+		cv::extractChannel(frame, slot.mask, 1);
+		cv::threshold(slot.mask, slot.mask, syntheticObjectLevel - 8, 255, cv::THRESH_BINARY);
+		slot.labels.create(frame.rows, frame.cols, CV_32S);
+		slot.parents.clear();
+		for (int y = 0; y < frame.rows; ++y)
+		{
+			const uchar *mask = slot.mask.ptr<uchar>(y);
+			int *labels = slot.labels.ptr<int>(y);
+			const int *above = y > 0 ? slot.labels.ptr<int>(y - 1) : nullptr;
+			for (int x = 0; x < frame.cols; ++x)
+			{
+				labels[x] = -1;
+				if (!mask[x])
+				{
+					continue;
+				}
+				int neighbours[4] = {
+					x > 0 ? labels[x - 1] : -1,
+					above && x > 0 ? above[x - 1] : -1,
+					above ? above[x] : -1,
+					above && x + 1 < frame.cols ? above[x + 1] : -1
+				};
+				int label = -1;
+				for (int n : neighbours)
+				{
+					if (n < 0)
+					{
+						continue;
+					}
+					n = findRoot(slot.parents, n);
+					if (label < 0)
+					{
+						label = n;
+					}
+					else if (n != label)
+					{
+						slot.parents[std::max(label, n)] = std::min(label, n);
+						label = std::min(label, n);
+					}
+				}
+				if (label < 0)
+				{
+					label = (int)slot.parents.size();
+					slot.parents.push_back(label);
+				}
+				labels[x] = label;
+			}
+		}
+
+		slot.boxes.assign(slot.parents.size(), Box{frame.cols, frame.rows, -1, -1});
+		for (int y = 0; y < frame.rows; ++y)
+		{
+			const int *labels = slot.labels.ptr<int>(y);
+			for (int x = 0; x < frame.cols; ++x)
+			{
+				if (labels[x] < 0)
+				{
+					continue;
+				}
+				Box &b = slot.boxes[findRoot(slot.parents, labels[x])];
+				b.xmin = std::min(b.xmin, x);
+				b.ymin = std::min(b.ymin, y);
+				b.xmax = std::max(b.xmax, x + 1);
+				b.ymax = std::max(b.ymax, y + 1);
+			}
+		}
+
+		for (size_t i = 0; i < slot.boxes.size(); ++i)
+		{
+			const Box &b = slot.boxes[i];
+			if (slot.parents[i] != (int)i)
+			{
+				continue;
+			}
+			Detection d;
+			d.label = frame.at<cv::Vec3b>((b.ymin + b.ymax) / 2, (b.xmin + b.xmax) / 2)[0] - 1;
+			d.confidence = 1.f;
+			d.xmin = (float)b.xmin / frame.cols;
+			d.ymin = (float)b.ymin / frame.rows;
+			d.xmax = (float)b.xmax / frame.cols;
+			d.ymax = (float)b.ymax / frame.rows;
+			slot.detections.push_back(d);
+		}
+	}
+
+	void loadScript(const std::string &path)
+	{
+		std::ifstream file(path);
+		if (!file.is_open())
+		{
+			throw std::logic_error("Could not open synthetic script " + path);
+		}
+		json obj;
+		file >> obj;
+		for (const auto &entry : obj)
+		{
+			std::vector<Detection> detections;
+			for (const auto &det : entry)
+			{
+				if (det.size() != 6)
+				{
+					throw std::logic_error("Synthetic detections must be [label, confidence, xmin, ymin, xmax, ymax]");
+				}
+				Detection d;
+				d.label = det[0];
+				d.confidence = det[1];
+				d.xmin = det[2];
+				d.ymin = det[3];
+				d.xmax = det[4];
+				d.ymax = det[5];
+				detections.push_back(d);
+			}
+			script.push_back(detections);
+		}
+	}
+
+	size_t width;
+	size_t height;
+	std::chrono::microseconds latency;
+	float threshold;
+	std::atomic<size_t> next;  // Requests may be submitted from several threads
+	std::vector<Slot> slots;
+	std::vector<std::vector<Detection>> script;
+};
+
+std::unique_ptr<InferenceBackend> createSyntheticBackend(const BackendConfig &config)
+{
+	return std::unique_ptr<InferenceBackend>(new SyntheticBackend(config));
+}
@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+#include <synthetic_source.hpp>
+
+static const std::string syntheticPrefix = "synthetic://";
+
+bool SyntheticCapture::isSyntheticUrl(const std::string &url)
+{
+	return url.compare(0, syntheticPrefix.size(), syntheticPrefix) == 0;
+}
+
+SyntheticCapture::SyntheticCapture(const std::string &url)
+	: opened(false)
+	, width(640)
+	, height(480)
+	, fps(30)
+	, pattern("bounce")
+	, frameCount(0)
+	, frameNo(0)
+	, label(0)
+	, paced(false)
+{
+	if (!isSyntheticUrl(url))
+	{
+		return;
+	}
+	std::string spec = url.substr(syntheticPrefix.size());
+	std::string query;
+	size_t q = spec.find('?');
+	if (q != std::string::npos)
+	{
+		query = spec.substr(q + 1);
+		spec = spec.substr(0, q);
+	}
+	size_t slash = spec.find('/');
+	if (slash != std::string::npos)
+	{
+		pattern = spec.substr(slash + 1);
+		spec = spec.substr(0, slash);
+	}
+	if (!spec.empty())
+	{
+		int w, h;
+		double f;
+		int n = sscanf(spec.c_str(), "%dx%d@%lf", &w, &h, &f);
+		if (n < 2 || w <= 0 || h <= 0 || (n == 3 && f <= 0))
+		{
+			return;
+		}
+		width = w;
+		height = h;
+		if (n == 3)
+		{
+			fps = f;
+		}
+	}
+	if (pattern != "static" && pattern != "bounce" && pattern != "walk")
+	{
+		return;
+	}
+
+	int numObjects = 3;
+	unsigned int seed = 1;
+	while (!query.empty())
+	{
+		size_t amp = query.find('&');
+		std::string param = query.substr(0, amp);
+		query = amp == std::string::npos ? "" : query.substr(amp + 1);
+		size_t eq = param.find('=');
+		if (eq == std::string::npos)
+		{
+			return;
+		}
+		std::string key = param.substr(0, eq);
+		long value = strtol(param.c_str() + eq + 1, nullptr, 10);
+		if (key == "objects")
+			numObjects = (int)value;
+		else if (key == "frames")
+			frameCount = value;
+		else if (key == "seed")
+			seed = (unsigned int)value;
+		else
+			return;
+	}
+
+	// Object sizes and speeds are random but fixed by the seed, so a given URL
+	// always produces the same video
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+	for (int i = 0; i < numObjects; ++i)
+	{
+		Object obj;
+		obj.width = std::max(4, (int)(width * (0.06f + 0.08f * unit(rng))));
+		obj.height = std::max(4, (int)(height * (0.15f + 0.2f * unit(rng))));
+		obj.x = unit(rng) * (width - obj.width);
+		obj.y = unit(rng) * (height - obj.height);
+		// Speeds in pixels per frame, about a frame width every 2 to 6 seconds
+		obj.vx = (width / (float)fps) * (0.15f + 0.35f * unit(rng)) * (unit(rng) < 0.5f ? -1 : 1);
+		obj.vy = (height / (float)fps) * (0.1f + 0.2f * unit(rng)) * (unit(rng) < 0.5f ? -1 : 1);
+		objects.push_back(obj);
+	}
+	opened = true;
+}
+
+void SyntheticCapture::setLabel(int label)
+{
+	this->label = label;
+}
+
+void SyntheticCapture::setPaced(bool paced)
+{
+	this->paced = paced;
+	nextFrameTime = std::chrono::steady_clock::now();
+}
+
+// Position p moving back and forth between 0 and range
+static float bounce(float p, float range)
+{
+	if (range <= 0)
+	{
+		return 0;
+	}
+	float period = 2 * range;
+	float m = std::fmod(p, period);
+	if (m < 0)
+	{
+		m += period;
+	}
+	return m <= range ? m : period - m;
+}
+
+cv::Rect SyntheticCapture::objectAt(const Object &obj, long frameNo) const
+{
+	float x = obj.x;
+	float y = obj.y;
+	if (pattern == "bounce")
+	{
+		x = bounce(obj.x + obj.vx * frameNo, (float)(width - obj.width));
+		y = bounce(obj.y + obj.vy * frameNo, (float)(height - obj.height));
+	}
+	else if (pattern == "walk")
+	{
+		// Walk to the right through the frame, then stay out of it for a while
+		// so that the object is counted again when it comes back
+		float track = 2.f * width + obj.width;
+		x = std::fmod(obj.x + std::fabs(obj.vx) * frameNo, track) - obj.width;
+	}
+	return cv::Rect((int)x, (int)y, obj.width, obj.height) & cv::Rect(0, 0, width, height);
+}
+
+bool SyntheticCapture::isOpened() const
+{
+	return opened;
+}
+
+void SyntheticCapture::release()
+{
+	opened = false;
+}
+
+bool SyntheticCapture::grab()
+{
+	if (!opened || (frameCount > 0 && frameNo >= frameCount))
+	{
+		return false;
+	}
+	if (paced)
+	{
+		// A late reader gets the frame at once, without a burst of frames to catch up
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		std::this_thread::sleep_until(nextFrameTime);
+		nextFrameTime = std::max(nextFrameTime, now) + std::chrono::microseconds((long)(1e6 / fps));
+	}
+	++frameNo;
+	return true;
+}
+
+bool SyntheticCapture::retrieve(cv::OutputArray image, int)
+{
+	if (!opened || frameNo == 0)
+	{
+		image.release();
+		return false;
+	}
+	image.create(height, width, CV_8UC3);
+	cv::Mat frame = image.getMat();
+	frame.setTo(cv::Scalar(0, 0, 0));
+	cv::Scalar color(label + 1, syntheticObjectLevel, syntheticObjectLevel);
+	for (const Object &obj : objects)
+	{
+		cv::Rect r = objectAt(obj, frameNo - 1);
+		if (r.area() > 0)
+		{
+			cv::rectangle(frame, r, color, cv::FILLED);
+		}
+	}
+	return true;
+}
+
+bool SyntheticCapture::read(cv::OutputArray image)
+{
+	if (grab())
+	{
+		return retrieve(image);
+	}
+	image.release();
+	return false;
+}
+
+bool SyntheticCapture::set(int propId, double value)
+{
+	if (propId == cv::CAP_PROP_POS_FRAMES && value >= 0)
+	{
+		frameNo = (long)value;
+		return true;
+	}
+	return false;
+}
+
+double SyntheticCapture::get(int propId) const
+{
+	switch (propId)
+	{
+	case cv::CAP_PROP_FRAME_WIDTH:
+		return width;
+	case cv::CAP_PROP_FRAME_HEIGHT:
+		return height;
+	case cv::CAP_PROP_FPS:
+		return fps;
+	case cv::CAP_PROP_FRAME_COUNT:
+		return frameCount > 0 ? frameCount : -1;
+	case cv::CAP_PROP_POS_FRAMES:
+		return frameNo;
+	case cv::CAP_PROP_POS_MSEC:
+		return frameNo * 1000.0 / fps;
+	default:
+		return 0;
+	}
+}
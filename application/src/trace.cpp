@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <trace.hpp>
+
+static const size_t traceChunkEvents = 4096;
+static const size_t traceMaxChunks = 1024;
+
+struct TraceRecord {
+	const char *name;
+	int64_t begin;
+	int64_t end;
+	int32_t stream;
+	int32_t frame;
+};
+
+// Events of one thread. Only the owner thread appends; the chunks and the count are
+// published with release stores, so traceWrite() can read them from another thread
+struct TraceBuffer {
+	int tid;
+	std::atomic<const char *> name;
+	std::atomic<size_t> count;
+	std::atomic<TraceRecord *> chunks[traceMaxChunks];
+
+	TraceBuffer(int tid)
+		: tid(tid)
+		, name(nullptr)
+		, count(0)
+	{
+		for (auto &c : chunks)
+		{
+			c.store(nullptr, std::memory_order_relaxed);
+		}
+	}
+
+	~TraceBuffer()
+	{
+		for (auto &c : chunks)
+		{
+			delete[] c.load();
+		}
+	}
+};
+
+std::atomic<bool> traceActive(false);
+
+static std::mutex traceMutex;
+static std::vector<std::unique_ptr<TraceBuffer>> traceBuffers;
+static std::atomic<size_t> traceBudget(0);
+static std::atomic<size_t> traceDropped(0);
+static thread_local TraceBuffer *threadBuffer = nullptr;
+
+static const std::chrono::steady_clock::time_point traceOrigin = std::chrono::steady_clock::now();
+
+int64_t traceNow()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - traceOrigin).count();
+}
+
+// Buffers are registered once per thread and kept until the end of the process, so
+// the events of threads that have exited are written as well
+static TraceBuffer *getThreadBuffer()
+{
+	if (!threadBuffer)
+	{
+		std::lock_guard<std::mutex> guard(traceMutex);
+		traceBuffers.emplace_back(new TraceBuffer((int)traceBuffers.size() + 1));
+		threadBuffer = traceBuffers.back().get();
+	}
+	return threadBuffer;
+}
+
+void traceStart(size_t maxEvents)
+{
+	traceBudget = maxEvents;
+	traceActive = true;
+}
+
+void traceStop()
+{
+	traceActive = false;
+}
+
+void traceThreadName(const char *name)
+{
+	getThreadBuffer()->name = name;
+}
+
+void traceEvent(const char *name, int64_t begin, int64_t end, int stream, int frame)
+{
+	if (!traceActive.load(std::memory_order_relaxed))
+	{
+		return;
+	}
+	// The budget bounds the memory used by all the threads together
+	size_t budget = traceBudget.load(std::memory_order_relaxed);
+	do
+	{
+		if (budget == 0)
+		{
+			traceDropped++;
+			return;
+		}
+	} while (!traceBudget.compare_exchange_weak(budget, budget - 1, std::memory_order_relaxed));
+
+	TraceBuffer *buffer = getThreadBuffer();
+	size_t n = buffer->count.load(std::memory_order_relaxed);
+	size_t chunk = n / traceChunkEvents;
+	if (chunk >= traceMaxChunks)
+	{
+		traceDropped++;
+		return;
+	}
+	TraceRecord *records = buffer->chunks[chunk].load(std::memory_order_relaxed);
+	if (!records)
+	{
+		records = new TraceRecord[traceChunkEvents];
+		buffer->chunks[chunk].store(records, std::memory_order_release);
+	}
+	TraceRecord &r = records[n % traceChunkEvents];
+	r.name = name;
+	r.begin = begin;
+	r.end = end;
+	r.stream = stream;
+	r.frame = frame;
+	buffer->count.store(n + 1, std::memory_order_release);
+}
+
+bool traceWrite(const std::string &path)
+{
+	FILE *f = fopen(path.c_str(), "w");
+	if (!f)
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> guard(traceMutex);
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	for (auto &buffer : traceBuffers)
+	{
+		const char *name = buffer->name.load();
+		if (name)
+		{
+			fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+				first ? "" : ",\n", buffer->tid, name);
+			first = false;
+		}
+		size_t count = buffer->count.load(std::memory_order_acquire);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const TraceRecord &r = buffer->chunks[i / traceChunkEvents].load(std::memory_order_acquire)[i % traceChunkEvents];
+			// Timestamps are in microseconds
+			fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+				first ? "" : ",\n", r.name, buffer->tid, r.begin / 1000.0, (r.end - r.begin) / 1000.0);
+			if (r.stream >= 0 || r.frame >= 0)
+			{
+				fprintf(f, ",\"args\":{\"stream\":%d,\"frame\":%d}", r.stream, r.frame);
+			}
+			fprintf(f, "}");
+			first = false;
+		}
+	}
+	fprintf(f, "\n],\"otherData\":{\"droppedEvents\":%zu}}\n", traceDropped.load());
+	return fclose(f) == 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <cstdio>
+#include <stdexcept>
+
+#include <inference_backend.hpp>
+
+// Networks of the same model reshaped to several input sizes, all compiled when
+// the backend is created. A frame goes to the variant of its size, and every
+// request remembers the variant it was submitted to, so the videos of a model can
+// switch variants at any frame, even in async mode.
+class VariantBackend : public InferenceBackend {
+public:
+	VariantBackend(const BackendConfig &config)
+		: submitted(config.requests, 0)
+	{
+		for (float scale : config.variants)
+		{
+			BackendConfig variant = config;
+			variant.variants.clear();
+			variant.scale = scale;
+			variants.push_back(createBackend(variant));
+			for (size_t v = 0; v + 1 < variants.size(); ++v)
+			{
+				if (variantSize(v) == variantSize(variants.size() - 1))
+				{
+					throw std::logic_error("Two variants of " + config.model + " have the same input size");
+				}
+			}
+		}
+		snprintf(backendName, sizeof(backendName), "%s, %zu variants", variants[0]->name(), variants.size());
+	}
+
+	const char *name() const
+	{
+		return backendName;
+	}
+
+	size_t inputWidth() const
+	{
+		return variants[0]->inputWidth();
+	}
+
+	size_t inputHeight() const
+	{
+		return variants[0]->inputHeight();
+	}
+
+	size_t requestCount() const
+	{
+		return submitted.size();
+	}
+
+	size_t variantCount() const
+	{
+		return variants.size();
+	}
+
+	cv::Size variantSize(size_t variant) const
+	{
+		return cv::Size((int)variants[variant]->inputWidth(), (int)variants[variant]->inputHeight());
+	}
+
+	void submit(size_t request, const cv::Mat &frame)
+	{
+		for (size_t v = 0; v < variants.size(); ++v)
+		{
+			if (frame.size() == variantSize(v))
+			{
+				submitted[request] = v;
+				variants[v]->submit(request, frame);
+				return;
+			}
+		}
+		throw std::logic_error("No variant of the network has the input size of the frame");
+	}
+
+	bool wait(size_t request, std::vector<Detection> &detections)
+	{
+		return variants[submitted[request]]->wait(request, detections);
+	}
+
+private:
+	std::vector<std::unique_ptr<InferenceBackend>> variants;
+	std::vector<size_t> submitted;
+	char backendName[32];
+};
+
+std::unique_ptr<InferenceBackend> createVariantBackend(const BackendConfig &config)
+{
+	return std::unique_ptr<InferenceBackend>(new VariantBackend(config));
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+// A checkpoint that fails to be written must not lose the journal records it
+// carried: once the disk accepts writes again, the checkpoint is restored with
+// the whole history. The write failure comes from a file size limit that stops
+// the journal from growing. The interval is longer than the test, so only the
+// explicit flushes write the checkpoints.
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <checkpoint.hpp>
+
+static const int intervalMs = 600000;
+
+static StreamCounters makeCounters(int totalCount, uint32_t historySize)
+{
+	StreamCounters c;
+	memset(&c, 0, sizeof(c));
+	snprintf(c.label, sizeof(c.label), "person");
+	c.totalCount = totalCount;
+	c.lastCorrectCount = totalCount;
+	c.frames = historySize;
+	c.historySize = historySize;
+	return c;
+}
+
+static CountRecord makeRecord(int frameNo, int count)
+{
+	CountRecord r;
+	memset(&r, 0, sizeof(r));
+	r.frameNo = frameNo;
+	r.count = count;
+	return r;
+}
+
+static off_t fileSize(const std::string &path)
+{
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+static int fail(const char *message)
+{
+	std::cout << "FAILED: " << message << std::endl;
+	return 1;
+}
+
+static void removeDir(const std::string &dir)
+{
+	DIR *d = opendir(dir.c_str());
+	if (d)
+	{
+		while (struct dirent *entry = readdir(d))
+		{
+			std::string name = entry->d_name;
+			if (name != "." && name != "..")
+			{
+				unlink((dir + "/" + name).c_str());
+			}
+		}
+		closedir(d);
+	}
+	rmdir(dir.c_str());
+}
+
+static int run(const std::string &dir)
+{
+	std::vector<StreamCounters> counters(1, makeCounters(0, 0));
+	std::vector<std::vector<CountRecord>> history;
+	CountRecord records[4] = {makeRecord(1, 1), makeRecord(2, 2), makeRecord(3, 1), makeRecord(4, 3)};
+
+	{
+		Checkpointer checkpointer(dir, 1, intervalMs);
+		if (checkpointer.restore(counters, history))
+		{
+			return fail("restored a checkpoint from an empty directory");
+		}
+		checkpointer.start(counters);
+		checkpointer.update(0, makeCounters(2, 2), records, 2);
+		if (!checkpointer.flush())
+		{
+			return fail("the first checkpoint was not written");
+		}
+
+		// The journal cannot grow any more: the next checkpoint fails
+		signal(SIGXFSZ, SIG_IGN);
+		struct rlimit limit;
+		getrlimit(RLIMIT_FSIZE, &limit);
+		struct rlimit full = limit;
+		full.rlim_cur = fileSize(dir + "/counts.journal");
+		setrlimit(RLIMIT_FSIZE, &full);
+		checkpointer.update(0, makeCounters(3, 4), records + 2, 2);
+		bool written = checkpointer.flush();
+
+		// The disk accepts writes again. The limit may have failed a write to
+		// stdout as well
+		setrlimit(RLIMIT_FSIZE, &limit);
+		std::cout.clear();
+		if (written)
+		{
+			return fail("the checkpoint was written past the file size limit");
+		}
+		if (fileSize(dir + "/counts.journal") != (off_t)full.rlim_cur)
+		{
+			return fail("the journal grew past the file size limit");
+		}
+		if (!checkpointer.flush())
+		{
+			return fail("the checkpoint was not written again after the failure");
+		}
+	}
+
+	Checkpointer checkpointer(dir, 1, intervalMs);
+	counters.assign(1, makeCounters(0, 0));
+	if (!checkpointer.restore(counters, history))
+	{
+		return fail("the checkpoint written after the failure was not restored");
+	}
+	if (counters[0].totalCount != 3 || history[0].size() != 4)
+	{
+		return fail("the restored checkpoint lost records");
+	}
+	for (size_t i = 0; i < 4; ++i)
+	{
+		if (history[0][i].frameNo != records[i].frameNo || history[0][i].count != records[i].count)
+		{
+			return fail("the restored history is out of order");
+		}
+	}
+	std::cout << "Checkpoint restored with " << history[0].size() << " records after a failed write" << std::endl;
+	return 0;
+}
+
+int main()
+{
+	char dirTemplate[] = "/tmp/stm-checkpoint-XXXXXX";
+	if (!mkdtemp(dirTemplate))
+	{
+		return fail("could not create the checkpoint directory");
+	}
+	int result = run(dirTemplate);
+	removeDir(dirTemplate);
+	return result;
+}